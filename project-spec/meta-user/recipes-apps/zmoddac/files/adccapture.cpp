@@ -0,0 +1,356 @@
+#include "adccapture.h"
+
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+#include "zmodlib/ZmodADC1410/zmodadc1410.h"
+
+#include "dmapool.h"
+
+// Poll interval of the consumer and of a stalled capture thread
+#define CAPTURE_POLL_US 50
+
+// Seconds a new ZMOD transfer waits for a timed-out triggered transfer to drain first
+#define DRAIN_TIMEOUT 1.0
+
+// Stream rate of the simulated source, which turns a trigger timeout into samples
+#define SIMULATED_SAMPLES_PER_SECOND 100000000.0
+
+// Signed 14-bit code of one channel of a packed word: I in [31:18], Q in [15:2]
+static int32_t channelCode(uint32_t word, uint8_t channel) {
+    return (int32_t)((channel ? word << 16 : word) & 0xFFFC0000u) >> 18;
+}
+
+static uint32_t packWord(int32_t i, int32_t q) {
+    i = std::min(std::max(i, -8192), 8191);
+    q = std::min(std::max(q, -8192), 8191);
+    return ((uint32_t)(i & 0x3FFF) << 18) | ((uint32_t)(q & 0x3FFF) << 2);
+}
+
+static bool crosses(int32_t previous, int32_t current, const AdcTrigger& trigger) {
+    if (trigger.edge == TRIGGER_RISING) {
+        return previous < trigger.level && current >= trigger.level;
+    }
+    return previous > trigger.level && current <= trigger.level;
+}
+
+size_t findLevelCrossing(const uint32_t* words, size_t count, const AdcTrigger& trigger) {
+    for (size_t n = 1; n < count; n++) {
+        if (crosses(channelCode(words[n - 1], trigger.channel), channelCode(words[n], trigger.channel), trigger)) {
+            return n;
+        }
+    }
+    return count;
+}
+
+bool acquireLevelTriggered(AdcBlockSource& source, uint32_t* buffer, size_t length,
+                           const AdcTrigger& trigger, size_t& crossing) {
+    crossing = length;
+    if (!source.acquireTriggered(buffer, length, trigger)) {
+        return false;
+    }
+    // The crossing is between the last pre-trigger sample and the trigger sample
+    const size_t scanFrom = trigger.window > 0 ? trigger.window - 1 : 0;
+    crossing = scanFrom + findLevelCrossing(buffer + scanFrom, length - scanFrom, trigger);
+    return true;
+}
+
+// A timed-out triggered transfer, parked per ADC until it has drained into its buffer
+struct ArmedTransfer {
+    uint32_t* buffer;
+    size_t length;
+    DmaBufferPool* pool;
+    bool freed;             // The owner gave the buffer back; release it once drained
+};
+
+static std::mutex s_armedMutex;
+static std::map<ZMODADC1410*, ArmedTransfer> s_armedTransfers;
+
+static void releaseBuffer(ZMODADC1410* adc, DmaBufferPool* pool, uint32_t* buffer, size_t length) {
+    if (pool) {
+        pool->release(buffer);
+        return;
+    }
+    adc->freeChannelsBuffer(buffer, length);
+}
+
+// Poll the DMA until the running transfer completes; false once timeout seconds have passed
+static bool waitForTransfer(ZMODADC1410* adc, double timeout) {
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout));
+    while (!adc->isDMATransferComplete()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        usleep(CAPTURE_POLL_US);
+    }
+    return true;
+}
+
+uint32_t* ZmodAdcSource::allocBlock(size_t length) {
+    if (m_pool) {
+        return m_pool->acquire(length);
+    }
+    return m_adc->allocChannelsBuffer(length);
+}
+
+void ZmodAdcSource::freeBlock(uint32_t* buffer, size_t length) {
+    std::lock_guard<std::mutex> lock(s_armedMutex);
+    std::map<ZMODADC1410*, ArmedTransfer>::iterator armed = s_armedTransfers.find(m_adc);
+    if (armed != s_armedTransfers.end() && armed->second.buffer == buffer) {
+        if (!m_adc->isDMATransferComplete()) {
+            // The DMA may still write here; drainArmed() releases it later
+            armed->second.freed = true;
+            return;
+        }
+        s_armedTransfers.erase(armed);
+    }
+    releaseBuffer(m_adc, m_pool, buffer, length);
+}
+
+bool ZmodAdcSource::drainArmed() {
+    std::lock_guard<std::mutex> lock(s_armedMutex);
+    std::map<ZMODADC1410*, ArmedTransfer>::iterator armed = s_armedTransfers.find(m_adc);
+    if (armed == s_armedTransfers.end()) {
+        return true;
+    }
+    // The trigger is still set up, so run the ADC until it fires and the transfer completes
+    m_adc->start();
+    bool drained = waitForTransfer(m_adc, DRAIN_TIMEOUT);
+    m_adc->stop();
+    if (!drained) {
+        std::cerr << "ADC: a timed-out trigger transfer is still armed" << std::endl;
+        return false;
+    }
+    if (armed->second.freed) {
+        releaseBuffer(m_adc, armed->second.pool, armed->second.buffer, armed->second.length);
+    }
+    s_armedTransfers.erase(armed);
+    return true;
+}
+
+bool ZmodAdcSource::acquire(uint32_t* buffer, size_t length) {
+    if (!drainArmed()) {
+        return false;
+    }
+    m_adc->acquireImmediatePolling(buffer, length);
+    return true;
+}
+
+bool ZmodAdcSource::acquireTriggered(uint32_t* buffer, size_t length, const AdcTrigger& trigger) {
+    if (!drainArmed()) {
+        return false;
+    }
+    // acquireTriggeredPolling() spins on the DMA until the level is crossed, however long
+    // that takes, so its steps are run here against a deadline instead. The IP takes the
+    // level as the raw 14-bit code and the window as the pre-trigger depth.
+    m_adc->setTransferSize(length);
+    m_adc->setTrigger(trigger.channel, (uint32_t)(trigger.level & 0x3FFF), (uint32_t)trigger.edge, trigger.window);
+    if (m_adc->startDMATransfer(buffer, length) != 0) {
+        std::cerr << "ADC trigger DMA transfer failed to start" << std::endl;
+        return false;
+    }
+    m_adc->start();
+    bool complete = waitForTransfer(m_adc, trigger.timeout);
+    m_adc->stop();
+    if (!complete) {
+        // Stopping the ADC leaves the transfer armed, so the buffer must not be reused yet
+        std::lock_guard<std::mutex> lock(s_armedMutex);
+        ArmedTransfer armed = { buffer, length, m_pool, false };
+        s_armedTransfers[m_adc] = armed;
+        return false;
+    }
+    return true;
+}
+
+SimulatedAdcSource::SimulatedAdcSource(int32_t noise, uint32_t seed)
+    : m_noise(noise), m_seed(seed), m_ramp(false), m_position(0), m_lastTrigger(0) {
+}
+
+uint32_t* SimulatedAdcSource::allocBlock(size_t length) {
+    return new uint32_t[length];
+}
+
+void SimulatedAdcSource::freeBlock(uint32_t* buffer, size_t length) {
+    delete[] buffer;
+}
+
+void SimulatedAdcSource::injectBurst(uint64_t start, size_t length, int32_t level) {
+    Burst burst = { start, length, level };
+    m_bursts.push_back(burst);
+}
+
+uint32_t SimulatedAdcSource::word(uint64_t index) const {
+    if (m_ramp) {
+        return (uint32_t)index;
+    }
+    // Hash of the stream index, so any sample can be regenerated on its own
+    uint32_t hash = (uint32_t)index * 2654435761u ^ (uint32_t)(index >> 32) ^ m_seed;
+    hash ^= hash >> 15;
+    hash *= 2246822519u;
+    hash ^= hash >> 13;
+    const int32_t span = 2 * m_noise + 1;
+    int32_t i = (int32_t)(hash & 0xFFFF) % span - m_noise;
+    int32_t q = (int32_t)(hash >> 16) % span - m_noise;
+    for (const Burst& burst : m_bursts) {
+        if (index >= burst.start && index < burst.start + burst.length) {
+            i += burst.level;
+            q += burst.level;
+        }
+    }
+    return packWord(i, q);
+}
+
+bool SimulatedAdcSource::acquire(uint32_t* buffer, size_t length) {
+    for (size_t n = 0; n < length; n++) {
+        buffer[n] = word(m_position + n);
+    }
+    m_position += length;
+    return true;
+}
+
+bool SimulatedAdcSource::acquireTriggered(uint32_t* buffer, size_t length, const AdcTrigger& trigger) {
+    if (trigger.window >= length) {
+        return false;
+    }
+    // Like the IP, the trigger is only armed once the pre-trigger window has filled
+    uint64_t index = m_position + std::max<uint64_t>(trigger.window, 1);
+    const uint64_t last = index + (uint64_t)(trigger.timeout * SIMULATED_SAMPLES_PER_SECOND);
+    int32_t previous = channelCode(word(index - 1), trigger.channel);
+    for (; index < last; index++) {
+        int32_t current = channelCode(word(index), trigger.channel);
+        if (crosses(previous, current, trigger)) {
+            break;
+        }
+        previous = current;
+    }
+    if (index == last) {
+        m_position = last;
+        return false;
+    }
+
+    m_lastTrigger = index;
+    m_position = index - trigger.window;
+    return acquire(buffer, length);
+}
+
+AdcCaptureEngine::AdcCaptureEngine(AdcBlockSource& source, size_t blockLength, size_t numBuffers)
+    : m_source(source), m_blockLength(blockLength), m_numBuffers(numBuffers),
+      m_filled(numBuffers), m_free(numBuffers),
+      m_stop(false), m_finished(true), m_failed(false),
+      m_blocksCaptured(0), m_discontinuities(0), m_stalls(0) {
+}
+
+AdcCaptureEngine::~AdcCaptureEngine() {
+    stop();
+}
+
+bool AdcCaptureEngine::start() {
+    stop();
+
+    for (size_t i = 0; i < m_numBuffers; i++) {
+        uint32_t* buffer = m_source.allocBlock(m_blockLength);
+        if (!buffer) {
+            std::cerr << "Capture engine: failed to allocate DMA buffer " << i << std::endl;
+            stop();
+            m_failed = true;
+            return false;
+        }
+        m_buffers.push_back(buffer);
+        m_free.push(buffer);
+    }
+
+    m_stop = false;
+    m_finished = false;
+    m_failed = false;
+    m_blocksCaptured = 0;
+    m_discontinuities = 0;
+    m_stalls = 0;
+    m_thread = std::thread(&AdcCaptureEngine::captureLoop, this);
+    return true;
+}
+
+void AdcCaptureEngine::stop() {
+    m_stop = true;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    m_finished = true;
+
+    // Empty both rings; every buffer is owned by m_buffers
+    CaptureBlock block;
+    while (m_filled.pop(block)) {
+    }
+    uint32_t* buffer;
+    while (m_free.pop(buffer)) {
+    }
+    for (uint32_t* owned : m_buffers) {
+        m_source.freeBlock(owned, m_blockLength);
+    }
+    m_buffers.clear();
+}
+
+void AdcCaptureEngine::captureLoop() {
+    uint64_t sequence = 0;
+    bool stalled = false;
+
+    while (!m_stop.load()) {
+        uint32_t* buffer;
+        if (!m_free.pop(buffer)) {
+            // Every buffer is queued or held by the consumer
+            if (!stalled) {
+                m_free.noteOverrun();
+                stalled = true;
+            }
+            usleep(CAPTURE_POLL_US);
+            continue;
+        }
+
+        if (!m_source.acquire(buffer, m_blockLength)) {
+            std::cerr << "Capture engine: ADC acquisition failed" << std::endl;
+            m_free.push(buffer);
+            m_failed = true;
+            break;
+        }
+
+        CaptureBlock block;
+        block.buffer = buffer;
+        block.length = m_blockLength;
+        block.sequence = sequence;
+        block.stalled = stalled;
+        block.discontinuity = stalled || (sequence > 0 && !m_source.continuous());
+        if (block.discontinuity) {
+            m_discontinuities++;
+        }
+        if (stalled) {
+            m_stalls++;
+        }
+        stalled = false;
+        sequence++;
+
+        // Cannot fail: at most numBuffers blocks exist
+        m_filled.push(block);
+        m_blocksCaptured++;
+    }
+    m_finished = true;
+}
+
+bool AdcCaptureEngine::next(CaptureBlock& block, long timeoutUs) {
+    long waited = 0;
+    while (!m_filled.pop(block)) {
+        if (m_finished.load() || waited >= timeoutUs) {
+            return false;
+        }
+        usleep(CAPTURE_POLL_US);
+        waited += CAPTURE_POLL_US;
+    }
+    return true;
+}
+
+void AdcCaptureEngine::release(const CaptureBlock& block) {
+    m_free.push(block.buffer);
+}
@@ -0,0 +1,231 @@
+#ifndef ADCCAPTURE_H
+#define ADCCAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "spscring.h"
+
+class ZMODADC1410;
+class DmaBufferPool;
+
+enum TriggerEdge {
+    TRIGGER_RISING = 0,     // Values match the ZmodADC1410 edge argument
+    TRIGGER_FALLING = 1
+};
+
+// Level trigger of a one-shot acquisition
+struct AdcTrigger {
+    uint8_t channel;        // 0 = channel 1 (I), 1 = channel 2 (Q)
+    int32_t level;          // Signed 14-bit raw level
+    TriggerEdge edge;
+    uint32_t window;        // Samples captured before the trigger sample
+    double timeout;         // Seconds to wait for the trigger before giving up
+};
+
+/*
+ * First sample in [1, count) of the packed words where the trigger channel
+ * crosses the level on the trigger edge: rising when the previous sample is
+ * below the level and this one is at or above it, falling the other way round.
+ * @return Index of the crossing, or count when there is none
+ */
+size_t findLevelCrossing(const uint32_t* words, size_t count, const AdcTrigger& trigger);
+
+/*
+ * Where captured blocks come from. The capture engine only talks to this
+ * interface, so it can be driven by the ZMOD ADC or by a simulated source.
+ */
+class AdcBlockSource {
+public:
+    virtual ~AdcBlockSource() {}
+    virtual uint32_t* allocBlock(size_t length) = 0;
+    virtual void freeBlock(uint32_t* buffer, size_t length) = 0;
+    // Fill the buffer with the next length samples of the stream; false when the source cannot capture
+    virtual bool acquire(uint32_t* buffer, size_t length) = 0;
+    /*
+     * Arm the level trigger and block until length samples are captured around
+     * it, trigger.window before the trigger sample and the rest from it on.
+     * @return false when the source has no trigger, the transfer failed or
+     *         no trigger arrived within trigger.timeout
+     */
+    virtual bool acquireTriggered(uint32_t* buffer, size_t length, const AdcTrigger& trigger) { return false; }
+    // True when back-to-back acquire() calls return adjacent samples of the stream
+    virtual bool continuous() const { return false; }
+};
+
+/*
+ * One level-triggered acquisition as the receive path makes it, and where the
+ * crossing landed in the buffer. The trigger sample should be the first one
+ * after the pre-trigger window.
+ * @param crossing - Receives the first crossing from the last pre-trigger sample
+ *                   on, or length when there is none
+ * @return false when the acquisition failed or timed out
+ */
+bool acquireLevelTriggered(AdcBlockSource& source, uint32_t* buffer, size_t length,
+                           const AdcTrigger& trigger, size_t& crossing);
+
+/*
+ * ZmodADC1410 DMA acquisition, leasing its buffers from a pool when given one.
+ * Every acquire() arms a single polled transfer, so samples arriving between
+ * two transfers are lost.
+ *
+ * A triggered transfer that times out stays armed in the DMA engine and would
+ * write into its buffer once the trigger arrives. Its buffer is therefore
+ * parked: freeBlock() keeps it, and the next acquisition on the same ADC first
+ * runs the ADC until the armed transfer drains into it. Only then is the
+ * buffer released and a new transfer started.
+ */
+class ZmodAdcSource : public AdcBlockSource {
+public:
+    explicit ZmodAdcSource(ZMODADC1410* adc, DmaBufferPool* pool = NULL) : m_adc(adc), m_pool(pool) {}
+    uint32_t* allocBlock(size_t length) override;
+    void freeBlock(uint32_t* buffer, size_t length) override;
+    // false when a timed-out triggered transfer is still armed and did not drain
+    bool acquire(uint32_t* buffer, size_t length) override;
+    // Hardware trigger of the ADC IP; polls until the DMA transfer completes
+    bool acquireTriggered(uint32_t* buffer, size_t length, const AdcTrigger& trigger) override;
+    bool continuous() const override { return false; }
+
+    /*
+     * Let a timed-out triggered transfer on this ADC complete into its parked
+     * buffer, releasing the buffer if its owner already gave it back.
+     * @return false when the transfer is still armed after the drain timeout
+     */
+    bool drainArmed();
+
+private:
+    ZMODADC1410* m_adc;
+    DmaBufferPool* m_pool;
+};
+
+/*
+ * Synthetic ADC stream of low-level noise on both channels with optional
+ * constant bursts. acquireTriggered() models the hardware trigger in software
+ * on the same packed words, so trigger handling can be checked without the
+ * ZMOD attached. In ramp mode every word is its own stream index instead, so
+ * the continuity of captured blocks can be checked exactly.
+ */
+class SimulatedAdcSource : public AdcBlockSource {
+public:
+    /*
+     * @param noise - Peak noise amplitude in raw codes
+     * @param seed - Noise generator seed
+     */
+    SimulatedAdcSource(int32_t noise, uint32_t seed);
+    uint32_t* allocBlock(size_t length) override;
+    void freeBlock(uint32_t* buffer, size_t length) override;
+    bool acquire(uint32_t* buffer, size_t length) override;
+    bool acquireTriggered(uint32_t* buffer, size_t length, const AdcTrigger& trigger) override;
+    bool continuous() const override { return true; }
+
+    // Replace the noise by the ramp word(index) == index
+    void setRamp(bool ramp) { m_ramp = ramp; }
+
+    /*
+     * Add a burst to the stream.
+     * @param start - Stream index of the first burst sample
+     * @param length - Burst length in samples
+     * @param level - Raw code added to both channels during the burst
+     */
+    void injectBurst(uint64_t start, size_t length, int32_t level);
+
+    // Stream index of the trigger sample of the last triggered acquisition
+    uint64_t lastTrigger() const { return m_lastTrigger; }
+
+private:
+    struct Burst {
+        uint64_t start;
+        size_t length;
+        int32_t level;
+    };
+
+    uint32_t word(uint64_t index) const;
+
+    int32_t m_noise;
+    uint32_t m_seed;
+    bool m_ramp;
+    uint64_t m_position;    // Stream index of the next sample
+    uint64_t m_lastTrigger;
+    std::vector<Burst> m_bursts;
+};
+
+// One completed block handed to the consumer
+struct CaptureBlock {
+    uint32_t* buffer;
+    size_t length;
+    uint64_t sequence;      // Increases by one for every block of a capture; counts blocks, not samples
+    bool discontinuity;     // Samples may be missing before this block: the source re-arms or the capture stalled
+    bool stalled;           // The consumer held every buffer, so the capture waited before this block
+};
+
+/*
+ * Threaded ADC capture engine.
+ *
+ * A fixed ring of DMA buffers is allocated once in start() and stays owned by
+ * the engine until stop(). A capture thread fills the next free buffer as soon
+ * as the previous one completes and hands completed blocks to the consumer in
+ * order, so acquisition overlaps the consumer's processing. The consumer
+ * returns each block with release().
+ *
+ * The capture is not gapless. Every block is a separate acquisition, and a
+ * source that is not continuous() (ZmodAdcSource re-arms a one-shot transfer
+ * per block) loses the samples arriving while it is re-armed, so every block
+ * after the first is flagged as a discontinuity. If every buffer is held by
+ * the consumer the capture thread also has to wait; the block captured after
+ * such a stall is flagged as stalled and counted.
+ */
+class AdcCaptureEngine {
+public:
+    AdcCaptureEngine(AdcBlockSource& source, size_t blockLength, size_t numBuffers);
+    ~AdcCaptureEngine();
+
+    bool start();
+    void stop();
+
+    /*
+     * Wait for the next completed block.
+     * @param block - Receives the block on success
+     * @param timeoutUs - Maximum wait in microseconds
+     * @return false on timeout or once the engine has stopped and drained
+     */
+    bool next(CaptureBlock& block, long timeoutUs);
+
+    // Give a block back to the capture thread
+    void release(const CaptureBlock& block);
+
+    bool failed() const { return m_failed.load(); }
+    size_t blockLength() const { return m_blockLength; }
+    size_t bufferCount() const { return m_numBuffers; }
+    size_t queued() const { return m_filled.size(); }
+    size_t highWater() const { return m_filled.highWater(); }
+    size_t overruns() const { return m_free.overruns(); }
+    uint64_t blocksCaptured() const { return m_blocksCaptured.load(); }
+    uint64_t discontinuities() const { return m_discontinuities.load(); }
+    uint64_t stalls() const { return m_stalls.load(); }
+
+private:
+    void captureLoop();
+
+    AdcBlockSource& m_source;
+    size_t m_blockLength;
+    size_t m_numBuffers;
+    std::vector<uint32_t*> m_buffers;
+
+    // Completed blocks: capture thread -> consumer
+    SpscRing<CaptureBlock> m_filled;
+    // Returned buffers: consumer -> capture thread
+    SpscRing<uint32_t*> m_free;
+
+    std::thread m_thread;
+    std::atomic<bool> m_stop;
+    std::atomic<bool> m_finished;
+    std::atomic<bool> m_failed;
+    std::atomic<uint64_t> m_blocksCaptured;
+    std::atomic<uint64_t> m_discontinuities;
+    std::atomic<uint64_t> m_stalls;
+};
+
+#endif // ADCCAPTURE_H
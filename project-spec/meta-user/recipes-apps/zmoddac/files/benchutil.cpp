@@ -0,0 +1,35 @@
+#include "benchutil.h"
+
+#include <time.h>
+
+static inline uint32_t nextState(uint32_t state) {
+    return state * 1664525u + 1013904223u;
+}
+
+// Top 24 bits of the state as a value in [-0.5, 0.5)
+static inline float centredUniform(uint32_t state) {
+    return (float)(state >> 8) / (1 << 24) - 0.5f;
+}
+
+double monotonicSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void fillRandomWords(uint32_t* out, size_t count, uint32_t seed) {
+    for (size_t n = 0; n < count; n++) {
+        seed = nextState(seed);
+        out[n] = seed;
+    }
+}
+
+void fillNoise(std::complex<float>* out, size_t count, uint32_t seed) {
+    for (size_t n = 0; n < count; n++) {
+        seed = nextState(seed);
+        float re = centredUniform(seed);
+        seed = nextState(seed);
+        float im = centredUniform(seed);
+        out[n] = std::complex<float>(re, im);
+    }
+}
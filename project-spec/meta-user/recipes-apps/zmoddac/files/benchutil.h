@@ -0,0 +1,22 @@
+#ifndef BENCHUTIL_H
+#define BENCHUTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <complex>
+
+// Seconds on the monotonic clock, for timing kernels and transfers
+double monotonicSeconds();
+
+/*
+ * Reproducible test signals for the benchmarks, from a linear congruential
+ * generator started at seed.
+ */
+
+// Successive generator states, i.e. uniformly random packed DMA words
+void fillRandomWords(uint32_t* out, size_t count, uint32_t seed);
+
+// Uniform complex noise in [-0.5, 0.5) on both parts
+void fillNoise(std::complex<float>* out, size_t count, uint32_t seed);
+
+#endif // BENCHUTIL_H
@@ -0,0 +1,109 @@
+#ifndef CAPTURESTORE_H
+#define CAPTURESTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+/*
+ * Bounded, contiguous store of the most recent capture samples.
+ *
+ * Samples are addressed by their absolute stream position. The store holds
+ * the positions [begin(), end()) in one contiguous buffer, so correlators can
+ * read any retained range through a plain pointer. The buffer grows on demand
+ * up to a fixed capacity. Once it is full, append() drops every sample before
+ * the caller's keepFrom position and moves the retained tail to the front.
+ * The caller keeps the detection history and, after a start pilot, everything
+ * from the pilot onwards. Memory use never exceeds capacity() samples.
+ */
+template <typename T>
+class CaptureStore {
+public:
+    explicit CaptureStore(size_t capacity)
+        : m_capacity(capacity), m_begin(0), m_size(0), m_dropped(0) {
+    }
+
+    size_t capacity() const { return m_capacity; }
+    size_t size() const { return m_size; }
+    // Samples currently allocated, the store's memory footprint
+    size_t allocated() const { return m_data.size(); }
+    // Samples discarded to stay within the capacity
+    uint64_t dropped() const { return m_dropped; }
+
+    uint64_t begin() const { return m_begin; }
+    uint64_t end() const { return m_begin + m_size; }
+    bool contains(uint64_t position, size_t count) const {
+        return position >= m_begin && position + count <= end();
+    }
+
+    // Pointer to the sample at an absolute position inside [begin(), end())
+    const T* at(uint64_t position) const { return m_data.data() + (position - m_begin); }
+    T* at(uint64_t position) { return m_data.data() + (position - m_begin); }
+
+    /*
+     * Append samples at end().
+     * @param data - Samples to append
+     * @param count - Number of samples
+     * @param keepFrom - Oldest position that must be retained; anything before it may be dropped
+     * @return false if the retained range plus the new samples would exceed the capacity;
+     *         nothing is appended in that case
+     */
+    bool append(const T* data, size_t count, uint64_t keepFrom) {
+        T* out = reserve(count, keepFrom);
+        if (!out) {
+            return false;
+        }
+        std::copy(data, data + count, out);
+        return true;
+    }
+
+    /*
+     * Make room for count samples at end() and return where to write them, so a
+     * producer can fill the store in place. Same dropping rules as append().
+     * @return Write pointer, or NULL if the samples do not fit
+     */
+    T* reserve(size_t count, uint64_t keepFrom) {
+        if (m_size + count > m_data.size()) {
+            compact(keepFrom);
+        }
+        if (m_size + count > m_data.size()) {
+            if (m_size + count > m_capacity) {
+                return NULL;
+            }
+            // Grow geometrically, but never past the capacity
+            m_data.resize(std::min(m_capacity, std::max(m_data.size() * 2, m_size + count)));
+        }
+        T* out = m_data.data() + m_size;
+        m_size += count;
+        return out;
+    }
+
+    // Drop everything and restart at stream position 0; the allocation is kept
+    void clear() {
+        m_begin = 0;
+        m_size = 0;
+        m_dropped = 0;
+    }
+
+private:
+    // Drop samples before keepFrom and move the rest to the front of the buffer
+    void compact(uint64_t keepFrom) {
+        if (keepFrom <= m_begin) {
+            return;
+        }
+        size_t drop = (size_t)std::min<uint64_t>(keepFrom - m_begin, m_size);
+        std::copy(m_data.begin() + drop, m_data.begin() + m_size, m_data.begin());
+        m_begin += drop;
+        m_size -= drop;
+        m_dropped += drop;
+    }
+
+    size_t m_capacity;
+    uint64_t m_begin;
+    size_t m_size;
+    uint64_t m_dropped;
+    std::vector<T> m_data;
+};
+
+#endif // CAPTURESTORE_H
@@ -0,0 +1,157 @@
+#include "carrier.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CARRIER_NEON 1
+#endif
+
+#include "benchutil.h"
+
+// Samples between re-anchoring the NCO phasors
+#define NCO_BLOCK_LENGTH 256
+
+// Noise seed of the NCO benchmark
+#define NCO_BENCH_SEED 0x13579BDF
+
+static double wrapPhase(double phase) {
+    return phase - 2.0 * M_PI * std::floor((phase + M_PI) / (2.0 * M_PI));
+}
+
+// sum x[k] * conj(p[k]) * exp(-j * frequency * k) over pilot samples [first, last)
+static std::complex<double> pilotCorrelation(const std::complex<float>* x, const std::vector<std::complex<float>>& pilot,
+                                             size_t first, size_t last, double frequency) {
+    std::complex<double> sum(0.0, 0.0);
+    for (size_t k = first; k < last; k++) {
+        sum += std::complex<double>(x[k]) * std::conj(std::complex<double>(pilot[k])) * std::polar(1.0, -frequency * k);
+    }
+    return sum;
+}
+
+CarrierEstimate estimateCarrier(const std::complex<float>* startWindow, const std::vector<std::complex<float>>& startPilot,
+                                const std::complex<float>* endWindow, const std::vector<std::complex<float>>& endPilot,
+                                size_t endOffset) {
+    CarrierEstimate estimate;
+    estimate.valid = false;
+    estimate.bothPilots = false;
+    estimate.frequency = 0.0;
+    estimate.phase = 0.0;
+
+    const size_t half = startPilot.size() / 2;
+    if (!startWindow || half == 0) {
+        return estimate;
+    }
+
+    // Coarse frequency from the two halves of the start pilot, half samples apart
+    std::complex<double> early = pilotCorrelation(startWindow, startPilot, 0, half, 0.0);
+    std::complex<double> late = pilotCorrelation(startWindow, startPilot, half, 2 * half, 0.0);
+    double frequency = std::arg(late * std::conj(early)) / half;
+
+    if (endWindow && !endPilot.empty() && endOffset > 0) {
+        // With the coarse offset removed inside each pilot, the correlation phases are the
+        // carrier phases at the two pilot starts; their difference over the whole frame gives
+        // the fine frequency on the 2*pi branch nearest the coarse estimate
+        const double startPhase = std::arg(pilotCorrelation(startWindow, startPilot, 0, startPilot.size(), frequency));
+        const double endPhase = std::arg(pilotCorrelation(endWindow, endPilot, 0, endPilot.size(), frequency));
+        const double measured = endPhase - startPhase;
+        const double branch = std::round((frequency * endOffset - measured) / (2.0 * M_PI));
+        frequency = (measured + 2.0 * M_PI * branch) / endOffset;
+        estimate.bothPilots = true;
+    }
+
+    estimate.valid = true;
+    estimate.frequency = frequency;
+    estimate.phase = std::arg(pilotCorrelation(startWindow, startPilot, 0, startPilot.size(), frequency));
+    return estimate;
+}
+
+Nco::Nco(double frequency, double phase)
+    : m_frequency(frequency), m_phase(wrapPhase(phase)) {
+}
+
+void Nco::derotate(std::complex<float>* x, size_t count) {
+    const std::complex<float> step = std::polar(1.0f, (float)(-4.0 * m_frequency));
+
+    for (size_t blockStart = 0; blockStart < count; blockStart += NCO_BLOCK_LENGTH) {
+        const size_t blockLength = std::min((size_t)NCO_BLOCK_LENGTH, count - blockStart);
+        std::complex<float>* block = x + blockStart;
+
+        // Phasors of the first four samples, exact from the double phase
+        float phasorReal[4], phasorImag[4];
+        for (int k = 0; k < 4; k++) {
+            double angle = -(m_phase + m_frequency * k);
+            phasorReal[k] = (float)std::cos(angle);
+            phasorImag[k] = (float)std::sin(angle);
+        }
+
+        size_t n = 0;
+#ifdef CARRIER_NEON
+        float32x4_t pr = vld1q_f32(phasorReal);
+        float32x4_t pi = vld1q_f32(phasorImag);
+        const float32x4_t sr = vdupq_n_f32(step.real());
+        const float32x4_t si = vdupq_n_f32(step.imag());
+        for (; n + 4 <= blockLength; n += 4) {
+            float* samples = reinterpret_cast<float*>(block + n);
+            float32x4x2_t v = vld2q_f32(samples);
+            float32x4x2_t r;
+            r.val[0] = vmlsq_f32(vmulq_f32(v.val[0], pr), v.val[1], pi);
+            r.val[1] = vmlaq_f32(vmulq_f32(v.val[0], pi), v.val[1], pr);
+            vst2q_f32(samples, r);
+            float32x4_t nextReal = vmlsq_f32(vmulq_f32(pr, sr), pi, si);
+            pi = vmlaq_f32(vmulq_f32(pr, si), pi, sr);
+            pr = nextReal;
+        }
+        vst1q_f32(phasorReal, pr);
+        vst1q_f32(phasorImag, pi);
+#else
+        for (; n + 4 <= blockLength; n += 4) {
+            for (int k = 0; k < 4; k++) {
+                float re = block[n + k].real();
+                float im = block[n + k].imag();
+                block[n + k] = std::complex<float>(re * phasorReal[k] - im * phasorImag[k],
+                                                   re * phasorImag[k] + im * phasorReal[k]);
+                float nextReal = phasorReal[k] * step.real() - phasorImag[k] * step.imag();
+                phasorImag[k] = phasorReal[k] * step.imag() + phasorImag[k] * step.real();
+                phasorReal[k] = nextReal;
+            }
+        }
+#endif
+        // Fewer than four samples left at the end of the stream
+        for (int k = 0; n < blockLength; n++, k++) {
+            block[n] *= std::complex<float>(phasorReal[k], phasorImag[k]);
+        }
+
+        m_phase = wrapPhase(m_phase + m_frequency * blockLength);
+    }
+}
+
+void Nco::benchmark(size_t count, std::ostream& report) {
+    std::vector<std::complex<float>> samples(count);
+    fillNoise(samples.data(), count, NCO_BENCH_SEED);
+    std::vector<std::complex<float>> original(samples);
+
+    const double phase = m_phase;
+    double t0 = monotonicSeconds();
+    derotate(samples.data(), count);
+    double t1 = monotonicSeconds();
+
+    // Largest deviation from an exact double-precision rotation
+    double maxError = 0.0;
+    for (size_t n = 0; n < count; n++) {
+        std::complex<double> exact = std::complex<double>(original[n]) * std::polar(1.0, -(phase + m_frequency * n));
+        maxError = std::max(maxError, std::abs(exact - std::complex<double>(samples[n])));
+    }
+    m_phase = phase;
+
+    report << "NCO derotation ("
+#ifdef CARRIER_NEON
+              << "NEON"
+#else
+              << "scalar"
+#endif
+              << "): " << (count / (t1 - t0)) * 1e-6 << " Msamples/s, max error " << maxError << std::endl;
+}
@@ -0,0 +1,62 @@
+#ifndef CARRIER_H
+#define CARRIER_H
+
+#include <stddef.h>
+#include <complex>
+#include <iosfwd>
+#include <vector>
+
+// Carrier offset of a frame, relative to its first sample
+struct CarrierEstimate {
+    bool valid;
+    bool bothPilots;        // Frequency refined with the end pilot
+    double frequency;       // Radians per sample
+    double phase;           // Radians at sample 0 of the start pilot
+};
+
+/*
+ * Estimate carrier frequency offset and common phase from the pilots.
+ *
+ * A coarse frequency comes from the phase step between the two halves of the
+ * start pilot; it is unambiguous while the offset turns less than half a cycle
+ * over half the pilot. With the coarse offset removed, the correlation
+ * c = sum x[k] * conj(p[k]) of each pilot carries the carrier phase at its
+ * first sample. With an end pilot, the phase difference between the two
+ * correlation peaks, spread over the whole frame, gives the fine frequency;
+ * the coarse estimate picks its 2*pi branch.
+ * @param startWindow - Received samples at the start pilot, startPilot.size() samples
+ * @param startPilot - Start pilot
+ * @param endWindow - Received samples at the end pilot, or NULL without an end pilot
+ * @param endPilot - End pilot
+ * @param endOffset - End pilot position minus start pilot position, in samples
+ */
+CarrierEstimate estimateCarrier(const std::complex<float>* startWindow, const std::vector<std::complex<float>>& startPilot,
+                                const std::complex<float>* endWindow, const std::vector<std::complex<float>>& endPilot,
+                                size_t endOffset);
+
+/*
+ * Numerically controlled oscillator that derotates samples in place by
+ * exp(-j * (phase + frequency * n)), n counting every sample since construction.
+ *
+ * Four phasors advance together by one complex multiply per sample, on ARM as
+ * NEON lanes. They are re-anchored from the double-precision phase every block
+ * so rounding never accumulates over long frames.
+ */
+class Nco {
+public:
+    Nco(double frequency, double phase);
+
+    double frequency() const { return m_frequency; }
+
+    // Derotate the next count samples of the stream
+    void derotate(std::complex<float>* x, size_t count);
+
+    // Time the kernel on noise and report Msamples/s
+    void benchmark(size_t count, std::ostream& report);
+
+private:
+    double m_frequency;
+    double m_phase;         // Phase of the next sample, kept in [-pi, pi)
+};
+
+#endif // CARRIER_H
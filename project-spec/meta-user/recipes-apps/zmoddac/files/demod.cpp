@@ -0,0 +1,154 @@
+#include "demod.h"
+
+#include <algorithm>
+#include <cmath>
+
+static int grayEncode(int value) {
+    return value ^ (value >> 1);
+}
+
+static int grayDecode(int code) {
+    int value = code;
+    for (int shift = code >> 1; shift != 0; shift >>= 1) {
+        value ^= shift;
+    }
+    return value;
+}
+
+QamDemodulator::QamDemodulator(int order)
+    : m_order(order), m_bits(0), m_side(1) {
+    while ((1 << m_bits) < order) {
+        m_bits++;
+    }
+    m_side = 1 << (m_bits / 2);
+    // Levels +-1, +-3, ... have an average energy of 2 (M - 1) / 3
+    m_scale = std::sqrt(2.0f * (order - 1) / 3.0f);
+}
+
+bool QamDemodulator::supported(int order) {
+    // 4, 16, 64, 256, ...: a power of two with an even exponent
+    if (order < 4 || (order & (order - 1)) != 0) {
+        return false;
+    }
+    int bits = 0;
+    while ((1 << bits) < order) {
+        bits++;
+    }
+    return bits % 2 == 0;
+}
+
+std::complex<float> QamDemodulator::symbol(int value) const {
+    const int half = m_bits / 2;
+    int column = grayDecode(value >> half);
+    int row = grayDecode(value & (m_side - 1));
+    float re = (float)(2 * column - (m_side - 1));
+    float im = (float)((m_side - 1) - 2 * row);
+    return std::complex<float>(re, im) / m_scale;
+}
+
+int QamDemodulator::slice(std::complex<float> sample) const {
+    // Back to the integer level grid, then round to the nearest level index
+    float re = sample.real() * m_scale;
+    float im = sample.imag() * m_scale;
+    int column = (int)std::floor((re + m_side) * 0.5f);
+    int row = (int)std::floor((m_side - im) * 0.5f);
+    column = std::min(std::max(column, 0), m_side - 1);
+    row = std::min(std::max(row, 0), m_side - 1);
+    return (grayEncode(column) << (m_bits / 2)) | grayEncode(row);
+}
+
+size_t recoverSymbols(const std::complex<float>* x, size_t count, size_t sps, std::vector<std::complex<float>>& symbols) {
+    symbols.clear();
+    if (sps == 0 || count == 0) {
+        return 0;
+    }
+
+    size_t bestPhase = 0;
+    double bestEnergy = -1.0;
+    for (size_t phase = 0; phase < std::min(sps, count); phase++) {
+        double energy = 0.0;
+        size_t taken = 0;
+        for (size_t n = phase; n < count; n += sps) {
+            energy += std::norm(x[n]);
+            taken++;
+        }
+        energy /= taken;
+        if (energy > bestEnergy) {
+            bestEnergy = energy;
+            bestPhase = phase;
+        }
+    }
+
+    symbols.reserve((count - bestPhase + sps - 1) / sps);
+    for (size_t n = bestPhase; n < count; n += sps) {
+        symbols.push_back(x[n]);
+    }
+
+    if (bestEnergy > 0.0) {
+        const float norm = (float)(1.0 / std::sqrt(bestEnergy));
+        for (auto& symbol : symbols) {
+            symbol *= norm;
+        }
+    }
+    return bestPhase;
+}
+
+void packSymbolBits(const std::vector<int>& values, int bitsPerSymbol, std::vector<uint8_t>& bytes) {
+    bytes.assign((values.size() * bitsPerSymbol + 7) / 8, 0);
+    size_t bit = 0;
+    for (int value : values) {
+        for (int b = bitsPerSymbol - 1; b >= 0; b--, bit++) {
+            if ((value >> b) & 1) {
+                bytes[bit / 8] |= (uint8_t)(0x80 >> (bit % 8));
+            }
+        }
+    }
+}
+
+std::vector<int> groupSymbolBits(const std::vector<uint8_t>& bits, int bitsPerSymbol) {
+    std::vector<int> values(bits.size() / bitsPerSymbol);
+    for (size_t n = 0; n < values.size(); n++) {
+        int value = 0;
+        for (int b = 0; b < bitsPerSymbol; b++) {
+            value = (value << 1) | (bits[n * bitsPerSymbol + b] & 1);
+        }
+        values[n] = value;
+    }
+    return values;
+}
+
+LinkMetrics measureLink(const QamDemodulator& demodulator, const std::vector<std::complex<float>>& symbols,
+                        const std::vector<int>& values, const std::vector<int>& reference) {
+    LinkMetrics metrics;
+    metrics.symbols = std::min(std::min(symbols.size(), values.size()), reference.size());
+    metrics.bits = metrics.symbols * demodulator.bitsPerSymbol();
+    metrics.bitErrors = 0;
+    metrics.evm = 0.0;
+    metrics.snrDb = 0.0;
+    if (metrics.symbols == 0) {
+        return metrics;
+    }
+
+    // Least-squares complex gain g minimising sum |r - g * s|^2 takes out the
+    // residual gain and common phase before the error vectors are measured
+    std::complex<double> crossSum(0.0, 0.0);
+    double referenceEnergy = 0.0;
+    for (size_t n = 0; n < metrics.symbols; n++) {
+        std::complex<double> ideal = demodulator.symbol(reference[n]);
+        crossSum += std::complex<double>(symbols[n]) * std::conj(ideal);
+        referenceEnergy += std::norm(ideal);
+        metrics.bitErrors += __builtin_popcount((unsigned)(values[n] ^ reference[n]));
+    }
+    const std::complex<double> gain = crossSum / referenceEnergy;
+
+    double errorEnergy = 0.0;
+    for (size_t n = 0; n < metrics.symbols; n++) {
+        errorEnergy += std::norm(std::complex<double>(symbols[n]) - gain * std::complex<double>(demodulator.symbol(reference[n])));
+    }
+    const double signalEnergy = std::norm(gain) * referenceEnergy;
+    if (signalEnergy > 0.0) {
+        metrics.evm = std::sqrt(errorEnergy / signalEnergy);
+        metrics.snrDb = errorEnergy > 0.0 ? 10.0 * std::log10(signalEnergy / errorEnergy) : INFINITY;
+    }
+    return metrics;
+}
@@ -0,0 +1,84 @@
+#ifndef DEMOD_H
+#define DEMOD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <complex>
+#include <vector>
+
+/*
+ * Square M-QAM with Gray mapping and unit average power, the constellation of
+ * MATLAB's qammod(x, M, "gray", UnitAveragePower=true).
+ *
+ * The upper half of a symbol's bits selects the in-phase level from left to
+ * right, the lower half the quadrature level from top to bottom, each as a
+ * Gray code. slice() is the matching hard decision of qamdemod().
+ */
+class QamDemodulator {
+public:
+    // order must be a square power of four, see supported()
+    explicit QamDemodulator(int order);
+
+    static bool supported(int order);
+
+    int order() const { return m_order; }
+    int bitsPerSymbol() const { return m_bits; }
+
+    // Constellation point of a symbol value
+    std::complex<float> symbol(int value) const;
+
+    // Nearest symbol value of a unit average power sample
+    int slice(std::complex<float> sample) const;
+
+private:
+    int m_order;
+    int m_bits;
+    int m_side;         // Levels per axis, sqrt(order)
+    float m_scale;      // Distance from a level index step to unit average power
+};
+
+/*
+ * Max-energy timing recovery: choose the sampling phase in [0, sps) with the
+ * largest mean |x|^2, decimate to one sample per symbol from that phase and
+ * normalise the symbols to unit average power.
+ * @param x - Matched-filtered samples
+ * @param count - Number of samples
+ * @param sps - Samples per symbol
+ * @param symbols - Receives floor((count - phase) / sps) symbols
+ * @return Chosen phase
+ */
+size_t recoverSymbols(const std::complex<float>* x, size_t count, size_t sps, std::vector<std::complex<float>>& symbols);
+
+/*
+ * Pack symbol values into bytes, bitsPerSymbol bits each, most significant bit
+ * first like de2bi(..., "left-msb"), in symbol order. The last byte is zero-padded.
+ */
+void packSymbolBits(const std::vector<int>& values, int bitsPerSymbol, std::vector<uint8_t>& bytes);
+
+/*
+ * Group a bit sequence into symbol values, bitsPerSymbol bits each, most
+ * significant bit first; the inverse of packSymbolBits() before packing.
+ * Trailing bits that do not fill a symbol are ignored.
+ */
+std::vector<int> groupSymbolBits(const std::vector<uint8_t>& bits, int bitsPerSymbol);
+
+// Data-aided link quality of one demodulated frame
+struct LinkMetrics {
+    size_t symbols;         // Symbols compared, the shorter of the frame and the reference
+    size_t bits;
+    size_t bitErrors;
+    double evm;             // RMS error vector over RMS reference, after a least-squares complex gain
+    double snrDb;           // Error vector SNR, 10 log10(1 / evm^2)
+};
+
+/*
+ * Compare a demodulated frame with the transmitted symbols.
+ * @param demodulator - Constellation of the frame
+ * @param symbols - Received symbols at unit average power
+ * @param values - Hard decisions of the received symbols
+ * @param reference - Transmitted symbol values
+ */
+LinkMetrics measureLink(const QamDemodulator& demodulator, const std::vector<std::complex<float>>& symbols,
+                        const std::vector<int>& values, const std::vector<int>& reference);
+
+#endif // DEMOD_H
@@ -0,0 +1,179 @@
+#include "dmapool.h"
+
+#include <algorithm>
+#include <iostream>
+
+DmaLease::DmaLease(DmaLease&& other)
+    : m_pool(other.m_pool), m_buffer(other.m_buffer), m_capacity(other.m_capacity) {
+    other.m_pool = NULL;
+    other.m_buffer = NULL;
+    other.m_capacity = 0;
+}
+
+DmaLease& DmaLease::operator=(DmaLease&& other) {
+    if (this != &other) {
+        reset();
+        m_pool = other.m_pool;
+        m_buffer = other.m_buffer;
+        m_capacity = other.m_capacity;
+        other.m_pool = NULL;
+        other.m_buffer = NULL;
+        other.m_capacity = 0;
+    }
+    return *this;
+}
+
+void DmaLease::reset() {
+    if (m_pool && m_buffer) {
+        m_pool->release(m_buffer);
+    }
+    m_pool = NULL;
+    m_buffer = NULL;
+    m_capacity = 0;
+}
+
+DmaBufferPool::DmaBufferPool(const char* name, AllocFn allocFn, FreeFn freeFn)
+    : m_name(name), m_alloc(allocFn), m_free(freeFn),
+      m_hits(0), m_misses(0), m_missHighWater(0), m_missInUse(0) {
+}
+
+DmaBufferPool::~DmaBufferPool() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& entry : m_leased) {
+        std::cerr << m_name << " pool: buffer still leased at shutdown" << std::endl;
+        m_free(entry.first, entry.second.length);
+    }
+    for (auto& sizeClass : m_classes) {
+        for (uint32_t* buffer : sizeClass.free) {
+            m_free(buffer, sizeClass.length);
+        }
+    }
+}
+
+bool DmaBufferPool::reserve(size_t length, size_t count) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = std::find_if(m_classes.begin(), m_classes.end(),
+                           [length](const SizeClass& c) { return c.length == length; });
+    if (it == m_classes.end()) {
+        SizeClass sizeClass;
+        sizeClass.length = length;
+        sizeClass.total = 0;
+        sizeClass.inUse = 0;
+        sizeClass.highWater = 0;
+        it = m_classes.insert(std::upper_bound(m_classes.begin(), m_classes.end(), length,
+                                               [](size_t l, const SizeClass& c) { return l < c.length; }),
+                              sizeClass);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t* buffer = m_alloc(length);
+        if (!buffer) {
+            std::cerr << m_name << " pool: reserved only " << i << " of " << count
+                      << " buffers of " << length << " words" << std::endl;
+            return false;
+        }
+        it->free.push_back(buffer);
+        it->total++;
+    }
+    return true;
+}
+
+uint32_t* DmaBufferPool::acquireLocked(size_t length, size_t& capacity) {
+    // Classes are kept sorted by length, so the first fit is the smallest
+    for (auto& sizeClass : m_classes) {
+        if (sizeClass.length < length || sizeClass.free.empty()) {
+            continue;
+        }
+        uint32_t* buffer = sizeClass.free.back();
+        sizeClass.free.pop_back();
+        sizeClass.inUse++;
+        sizeClass.highWater = std::max(sizeClass.highWater, sizeClass.inUse);
+        m_leased[buffer] = Leased{true, sizeClass.length};
+        m_hits++;
+        capacity = sizeClass.length;
+        return buffer;
+    }
+
+    // No pooled buffer fits: map one on demand
+    uint32_t* buffer = m_alloc(length);
+    if (!buffer) {
+        capacity = 0;
+        return NULL;
+    }
+    m_leased[buffer] = Leased{false, length};
+    m_misses++;
+    m_missInUse++;
+    m_missHighWater = std::max(m_missHighWater, m_missInUse);
+    capacity = length;
+    return buffer;
+}
+
+DmaLease DmaBufferPool::lease(size_t length) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t capacity = 0;
+    uint32_t* buffer = acquireLocked(length, capacity);
+    if (!buffer) {
+        return DmaLease();
+    }
+    return DmaLease(this, buffer, capacity);
+}
+
+uint32_t* DmaBufferPool::acquire(size_t length) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t capacity = 0;
+    return acquireLocked(length, capacity);
+}
+
+void DmaBufferPool::release(uint32_t* buffer) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_leased.find(buffer);
+    if (it == m_leased.end()) {
+        std::cerr << m_name << " pool: release of unknown buffer" << std::endl;
+        return;
+    }
+    Leased leased = it->second;
+    m_leased.erase(it);
+
+    if (!leased.pooled) {
+        m_free(buffer, leased.length);
+        m_missInUse--;
+        return;
+    }
+    for (auto& sizeClass : m_classes) {
+        if (sizeClass.length == leased.length) {
+            sizeClass.inUse--;
+            sizeClass.free.push_back(buffer);
+            break;
+        }
+    }
+}
+
+size_t DmaBufferPool::hits() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+}
+
+size_t DmaBufferPool::misses() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_misses;
+}
+
+size_t DmaBufferPool::reservedBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t bytes = 0;
+    for (const auto& sizeClass : m_classes) {
+        bytes += sizeClass.total * sizeClass.length * sizeof(uint32_t);
+    }
+    return bytes;
+}
+
+void DmaBufferPool::printStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::cout << m_name << " DMA pool: hits " << m_hits << ", misses " << m_misses
+              << " (on-demand high-water " << m_missHighWater << ")" << std::endl;
+    for (const auto& sizeClass : m_classes) {
+        std::cout << "  " << sizeClass.length << " words: " << sizeClass.inUse << "/" << sizeClass.total
+                  << " in use, high-water " << sizeClass.highWater << std::endl;
+    }
+}
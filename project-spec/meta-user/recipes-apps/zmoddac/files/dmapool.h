@@ -0,0 +1,104 @@
+#ifndef DMAPOOL_H
+#define DMAPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+class DmaBufferPool;
+
+/*
+ * RAII handle on a leased DMA buffer. Move-only; the buffer goes back to its
+ * pool when the lease is destroyed or reset.
+ */
+class DmaLease {
+public:
+    DmaLease() : m_pool(NULL), m_buffer(NULL), m_capacity(0) {}
+    DmaLease(DmaLease&& other);
+    DmaLease& operator=(DmaLease&& other);
+    ~DmaLease() { reset(); }
+
+    uint32_t* data() const { return m_buffer; }
+    // Usable length in 32-bit words; may exceed the requested length
+    size_t capacity() const { return m_capacity; }
+    explicit operator bool() const { return m_buffer != NULL; }
+
+    void reset();
+
+private:
+    friend class DmaBufferPool;
+    DmaLease(DmaBufferPool* pool, uint32_t* buffer, size_t capacity)
+        : m_pool(pool), m_buffer(buffer), m_capacity(capacity) {}
+    DmaLease(const DmaLease&) = delete;
+    DmaLease& operator=(const DmaLease&) = delete;
+
+    DmaBufferPool* m_pool;
+    uint32_t* m_buffer;
+    size_t m_capacity;
+};
+
+/*
+ * Size-class pool of pre-mapped DMA buffers for one ZMOD device.
+ *
+ * Buffers are reserved once at startup with reserve() and handed out by
+ * lease()/acquire(). A request is served from the smallest size class that
+ * fits and has a free buffer (a hit); otherwise a buffer of exactly the
+ * requested length is mapped on demand and unmapped again on return (a miss).
+ */
+class DmaBufferPool {
+public:
+    typedef std::function<uint32_t*(size_t)> AllocFn;
+    typedef std::function<void(uint32_t*, size_t)> FreeFn;
+
+    DmaBufferPool(const char* name, AllocFn allocFn, FreeFn freeFn);
+    ~DmaBufferPool();
+
+    // Pre-map count buffers of length words; returns false if the CMA budget ran out
+    bool reserve(size_t length, size_t count);
+
+    DmaLease lease(size_t length);
+
+    // Raw interface for owners that manage the buffer lifetime themselves
+    uint32_t* acquire(size_t length);
+    void release(uint32_t* buffer);
+
+    size_t hits() const;
+    size_t misses() const;
+    size_t reservedBytes() const;
+    void printStats() const;
+
+private:
+    friend class DmaLease;
+
+    struct SizeClass {
+        size_t length;
+        size_t total;
+        size_t inUse;
+        size_t highWater;
+        std::vector<uint32_t*> free;
+    };
+
+    // A buffer out on lease; on-demand buffers are unmapped on return
+    struct Leased {
+        bool pooled;
+        size_t length;
+    };
+
+    uint32_t* acquireLocked(size_t length, size_t& capacity);
+
+    const char* m_name;
+    AllocFn m_alloc;
+    FreeFn m_free;
+    std::vector<SizeClass> m_classes;
+    std::map<uint32_t*, Leased> m_leased;
+    size_t m_hits;
+    size_t m_misses;
+    size_t m_missHighWater;
+    size_t m_missInUse;
+    mutable std::mutex m_mutex;
+};
+
+#endif // DMAPOOL_H
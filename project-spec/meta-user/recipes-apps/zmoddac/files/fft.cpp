@@ -0,0 +1,89 @@
+#include "fft.h"
+
+#include <cmath>
+#include <utility>
+
+FFT::FFT() : m_size(0) {
+}
+
+FFT::FFT(size_t size) : m_size(0) {
+    init(size);
+}
+
+size_t FFT::nextPowerOfTwo(size_t n) {
+    size_t p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+void FFT::init(size_t size) {
+    if (size == m_size) {
+        return;
+    }
+    m_size = size;
+
+    // Bit-reversal permutation table
+    int bits = 0;
+    while (((size_t)1 << bits) < size) {
+        bits++;
+    }
+    m_bitReverse.resize(size);
+    for (size_t i = 0; i < size; i++) {
+        size_t r = 0;
+        for (int b = 0; b < bits; b++) {
+            if (i & ((size_t)1 << b)) {
+                r |= (size_t)1 << (bits - 1 - b);
+            }
+        }
+        m_bitReverse[i] = r;
+    }
+
+    // Twiddles for the largest stage; smaller stages stride through them.
+    // Computed in double so that long transforms do not accumulate phase error.
+    m_twiddles.resize(size / 2);
+    for (size_t k = 0; k < size / 2; k++) {
+        double angle = -2.0 * M_PI * (double)k / (double)size;
+        m_twiddles[k] = std::complex<float>((float)std::cos(angle), (float)std::sin(angle));
+    }
+}
+
+void FFT::forward(std::complex<float>* data) const {
+    transform(data, false);
+}
+
+void FFT::inverse(std::complex<float>* data) const {
+    transform(data, true);
+}
+
+void FFT::transform(std::complex<float>* data, bool inverse) const {
+    const size_t n = m_size;
+
+    for (size_t i = 0; i < n; i++) {
+        size_t j = m_bitReverse[i];
+        if (j > i) {
+            std::swap(data[i], data[j]);
+        }
+    }
+
+    for (size_t len = 2; len <= n; len <<= 1) {
+        const size_t half = len / 2;
+        const size_t stride = n / len;
+        for (size_t start = 0; start < n; start += len) {
+            for (size_t k = 0; k < half; k++) {
+                std::complex<float> w = m_twiddles[k * stride];
+                if (inverse) {
+                    w = std::conj(w);
+                }
+                std::complex<float> a = data[start + k];
+                std::complex<float> b = data[start + k + half];
+                // Explicit complex multiply avoids the NaN/Inf handling of operator*
+                std::complex<float> t(b.real() * w.real() - b.imag() * w.imag(),
+                                      b.real() * w.imag() + b.imag() * w.real());
+                data[start + k] = a + t;
+                data[start + k + half] = a - t;
+            }
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <stddef.h>
+#include <complex>
+#include <vector>
+
+/*
+ * In-place iterative radix-2 complex FFT.
+ * Twiddle factors and the bit-reversal permutation are computed once per size,
+ * so a single instance can be reused for every block of a streaming transform.
+ */
+class FFT {
+public:
+    FFT();
+    explicit FFT(size_t size);
+
+    // (Re)initialise for the given size, which must be a power of two
+    void init(size_t size);
+    size_t size() const { return m_size; }
+
+    // Unscaled forward transform
+    void forward(std::complex<float>* data) const;
+    // Unscaled inverse transform (caller applies the 1/N factor)
+    void inverse(std::complex<float>* data) const;
+
+    // Smallest power of two that is >= n
+    static size_t nextPowerOfTwo(size_t n);
+
+private:
+    void transform(std::complex<float>* data, bool inverse) const;
+
+    size_t m_size;
+    std::vector<size_t> m_bitReverse;
+    std::vector<std::complex<float>> m_twiddles;
+};
+
+#endif // FFT_H
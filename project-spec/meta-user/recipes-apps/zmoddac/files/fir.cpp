@@ -0,0 +1,350 @@
+#include "fir.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FIR_NEON 1
+#endif
+
+#include "benchutil.h"
+
+// Noise seed of the FIR and resampler benchmarks
+#define FIR_BENCH_SEED 0x2468ACE0
+
+std::vector<float> designRootRaisedCosine(float rolloff, int span, int sps) {
+    const int length = span * sps + 1;
+    const double beta = rolloff;
+    std::vector<double> taps(length);
+
+    for (int n = 0; n < length; n++) {
+        double t = (double)(n - span * sps / 2) / sps;
+        if (t == 0.0) {
+            taps[n] = -1.0 / (M_PI * sps) * (M_PI * (beta - 1.0) - 4.0 * beta);
+        } else if (beta == 0.0) {
+            // Without excess bandwidth the pulse is a plain sinc
+            taps[n] = std::sin(M_PI * t) / (M_PI * t * sps);
+        } else if (std::fabs(std::fabs(4.0 * beta * t) - 1.0) < 1e-9) {
+            // Removable singularity at t = +/-1 / (4 * beta)
+            taps[n] = 1.0 / (2.0 * M_PI * sps) *
+                      (M_PI * (beta + 1.0) * std::sin(M_PI * (beta + 1.0) / (4.0 * beta)) -
+                       4.0 * beta * std::sin(M_PI * (beta - 1.0) / (4.0 * beta)) +
+                       M_PI * (beta - 1.0) * std::cos(M_PI * (beta - 1.0) / (4.0 * beta)));
+        } else {
+            taps[n] = -4.0 * beta / sps *
+                      (std::cos((1.0 + beta) * M_PI * t) + std::sin((1.0 - beta) * M_PI * t) / (4.0 * beta * t)) /
+                      (M_PI * ((4.0 * beta * t) * (4.0 * beta * t) - 1.0));
+        }
+    }
+
+    double energy = 0.0;
+    for (double tap : taps) {
+        energy += tap * tap;
+    }
+    const double norm = 1.0 / std::sqrt(energy);
+
+    std::vector<float> result(length);
+    for (int n = 0; n < length; n++) {
+        result[n] = (float)(taps[n] * norm);
+    }
+    return result;
+}
+
+// Dot product of padded reversed taps with the window starting at x; length is a multiple of four
+static float dotProduct(const float* h, const float* x, size_t length) {
+#ifdef FIR_NEON
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (size_t k = 0; k < length; k += 4) {
+        acc = vmlaq_f32(acc, vld1q_f32(x + k), vld1q_f32(h + k));
+    }
+    float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#else
+    float acc0 = 0.0f, acc1 = 0.0f, acc2 = 0.0f, acc3 = 0.0f;
+    for (size_t k = 0; k < length; k += 4) {
+        acc0 += x[k] * h[k];
+        acc1 += x[k + 1] * h[k + 1];
+        acc2 += x[k + 2] * h[k + 2];
+        acc3 += x[k + 3] * h[k + 3];
+    }
+    return (acc0 + acc1) + (acc2 + acc3);
+#endif
+}
+
+FirDecimator::FirDecimator(const std::vector<float>& taps, size_t decimation)
+    : m_tapCount(taps.size()), m_decimation(std::max((size_t)1, decimation)), m_skip(0) {
+    // Reverse so each output is a forward dot product; the front padding multiplies
+    // the oldest history samples by zero
+    const size_t padded = (m_tapCount + 3) & ~(size_t)3;
+    m_taps.assign(padded, 0.0f);
+    for (size_t k = 0; k < m_tapCount; k++) {
+        m_taps[padded - 1 - k] = taps[k];
+    }
+    reset(0);
+}
+
+void FirDecimator::reset(size_t firstOutput) {
+    const size_t history = m_taps.empty() ? 0 : m_taps.size() - 1;
+    m_real.assign(history, 0.0f);
+    m_imag.assign(history, 0.0f);
+    m_skip = firstOutput;
+}
+
+void FirDecimator::process(const std::complex<float>* in, size_t count, std::vector<std::complex<float>>& out) {
+    if (m_taps.empty() || count == 0) {
+        return;
+    }
+
+    const size_t history = m_taps.size() - 1;
+    m_real.resize(history + count);
+    m_imag.resize(history + count);
+    for (size_t n = 0; n < count; n++) {
+        m_real[history + n] = in[n].real();
+        m_imag[history + n] = in[n].imag();
+    }
+
+    // Jump straight from one kept output to the next
+    size_t n = m_skip;
+    for (; n < count; n += m_decimation) {
+        out.push_back(std::complex<float>(dotProduct(m_taps.data(), m_real.data() + n, m_taps.size()),
+                                          dotProduct(m_taps.data(), m_imag.data() + n, m_taps.size())));
+    }
+    m_skip = n - count;
+
+    // Keep the last history samples for the next block
+    std::copy(m_real.end() - history, m_real.end(), m_real.begin());
+    std::copy(m_imag.end() - history, m_imag.end(), m_imag.begin());
+    m_real.resize(history);
+    m_imag.resize(history);
+}
+
+void FirDecimator::filterAligned(const std::complex<float>* in, size_t count, std::vector<std::complex<float>>& out) {
+    reset(delay());
+    out.reserve(out.size() + (count + m_decimation - 1) / m_decimation);
+    process(in, count, out);
+    // Flush the group delay with zeros so the last inputs still produce outputs
+    std::vector<std::complex<float>> tail(delay(), std::complex<float>(0.0f, 0.0f));
+    process(tail.data(), tail.size(), out);
+}
+
+void FirDecimator::benchmark(size_t count, std::ostream& report) {
+    std::vector<std::complex<float>> in(count);
+    fillNoise(in.data(), count, FIR_BENCH_SEED);
+    std::vector<std::complex<float>> out;
+
+    double t0 = monotonicSeconds();
+    filterAligned(in.data(), count, out);
+    double t1 = monotonicSeconds();
+
+    report << "FIR decimator (" << m_tapCount << " taps, decimation " << m_decimation << ", "
+#ifdef FIR_NEON
+              << "NEON"
+#else
+              << "scalar"
+#endif
+              << "): " << (count / (t1 - t0)) * 1e-6 << " input Msamples/s" << std::endl;
+}
+
+// Zeroth-order modified Bessel function of the first kind, for the Kaiser window
+static double besselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-17) {
+            break;
+        }
+    }
+    return sum;
+}
+
+static size_t greatestCommonDivisor(size_t a, size_t b) {
+    while (b != 0) {
+        size_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+std::vector<float> designResampleFilter(size_t interpolation, size_t decimation) {
+    const int halfLength = 10;
+    const double kaiserBeta = 5.0;
+    const size_t maxFactor = std::max(interpolation, decimation);
+    const size_t length = 2 * halfLength * maxFactor + 1;
+    const double cutoff = 1.0 / (2.0 * maxFactor);
+    const double center = (length - 1) / 2.0;
+
+    std::vector<double> taps(length);
+    double sum = 0.0;
+    for (size_t n = 0; n < length; n++) {
+        double t = n - center;
+        double sinc = (t == 0.0) ? 1.0 : std::sin(2.0 * M_PI * cutoff * t) / (2.0 * M_PI * cutoff * t);
+        double r = t / center;
+        double window = besselI0(kaiserBeta * std::sqrt(std::max(0.0, 1.0 - r * r))) / besselI0(kaiserBeta);
+        taps[n] = 2.0 * cutoff * sinc * window;
+        sum += taps[n];
+    }
+
+    std::vector<float> result(length);
+    for (size_t n = 0; n < length; n++) {
+        result[n] = (float)(taps[n] * interpolation / sum);
+    }
+    return result;
+}
+
+RationalResampler::RationalResampler(size_t interpolation, size_t decimation) {
+    interpolation = std::max((size_t)1, interpolation);
+    decimation = std::max((size_t)1, decimation);
+    const size_t divisor = greatestCommonDivisor(interpolation, decimation);
+    m_interpolation = interpolation / divisor;
+    m_decimation = decimation / divisor;
+
+    m_prototype = designResampleFilter(m_interpolation, m_decimation);
+    m_delay = (m_prototype.size() - 1) / 2;
+
+    // Phase p holds taps p, p + P, p + 2P, ... reversed, so that an output landing
+    // on phase p at input j is a forward dot product over inputs ending at j
+    const size_t taps = (m_prototype.size() + m_interpolation - 1) / m_interpolation;
+    m_phaseLength = (taps + 3) & ~(size_t)3;
+    m_phases.assign(m_interpolation * m_phaseLength, 0.0f);
+    for (size_t p = 0; p < m_interpolation; p++) {
+        float* phase = &m_phases[p * m_phaseLength];
+        for (size_t k = 0; p + k * m_interpolation < m_prototype.size(); k++) {
+            phase[m_phaseLength - 1 - k] = m_prototype[p + k * m_interpolation];
+        }
+    }
+    reset();
+}
+
+void RationalResampler::reset() {
+    m_real.assign(m_phaseLength - 1, 0.0f);
+    m_imag.assign(m_phaseLength - 1, 0.0f);
+    m_time = m_delay;
+    m_inputs = 0;
+    m_outputs = 0;
+}
+
+void RationalResampler::process(const std::complex<float>* in, size_t count, std::vector<std::complex<float>>& out) {
+    if (count == 0) {
+        return;
+    }
+
+    const size_t history = m_phaseLength - 1;
+    m_real.resize(history + count);
+    m_imag.resize(history + count);
+    for (size_t n = 0; n < count; n++) {
+        m_real[history + n] = in[n].real();
+        m_imag[history + n] = in[n].imag();
+    }
+
+    // Output time t lands on input t / P with phase t % P; the window for input j
+    // starts at history index j
+    for (; m_time / m_interpolation < count; m_time += m_decimation) {
+        const size_t input = m_time / m_interpolation;
+        const float* phase = &m_phases[(m_time % m_interpolation) * m_phaseLength];
+        out.push_back(std::complex<float>(dotProduct(phase, m_real.data() + input, m_phaseLength),
+                                          dotProduct(phase, m_imag.data() + input, m_phaseLength)));
+        m_outputs++;
+    }
+    m_time -= (uint64_t)count * m_interpolation;
+    m_inputs += count;
+
+    // Keep the last history samples for the next block
+    std::copy(m_real.end() - history, m_real.end(), m_real.begin());
+    std::copy(m_imag.end() - history, m_imag.end(), m_imag.begin());
+    m_real.resize(history);
+    m_imag.resize(history);
+}
+
+void RationalResampler::flush(std::vector<std::complex<float>>& out) {
+    const uint64_t target = outputLength(m_inputs);
+    if (m_outputs >= target) {
+        return;
+    }
+
+    // Zero inputs up to the one the last owed output lands on, then drop any extra outputs
+    const uint64_t lastTime = (target - 1) * m_decimation + m_delay;
+    const size_t zeros = (size_t)(lastTime / m_interpolation + 1 - m_inputs);
+    std::vector<std::complex<float>> tail(zeros, std::complex<float>(0.0f, 0.0f));
+    process(tail.data(), tail.size(), out);
+    out.resize(out.size() - (size_t)(m_outputs - target));
+    m_outputs = target;
+}
+
+void RationalResampler::benchmark(size_t count, std::ostream& report) {
+    // Reference: zero-stuff by P, convolve with the full prototype, keep every Q-th
+    // sample after the group delay
+    const size_t referenceInputs = 1000;
+    std::vector<std::complex<float>> in(std::max(count, referenceInputs));
+    fillNoise(in.data(), in.size(), FIR_BENCH_SEED);
+
+    const size_t upsampledLength = referenceInputs * m_interpolation;
+    std::vector<std::complex<double>> upsampled(upsampledLength);
+    for (size_t n = 0; n < referenceInputs; n++) {
+        upsampled[n * m_interpolation] = in[n];
+    }
+    std::vector<std::complex<float>> streamed;
+    reset();
+    // Uneven blocks so the phase and history carry across block boundaries
+    for (size_t offset = 0; offset < referenceInputs; offset += 97) {
+        process(in.data() + offset, std::min((size_t)97, referenceInputs - offset), streamed);
+    }
+    flush(streamed);
+
+    double maxError = 0.0;
+    for (size_t m = 0; m < streamed.size(); m++) {
+        const size_t t = m * m_decimation + m_delay;
+        std::complex<double> reference(0.0, 0.0);
+        for (size_t k = 0; k < m_prototype.size() && k <= t; k++) {
+            if (t - k < upsampledLength) {
+                reference += upsampled[t - k] * (double)m_prototype[k];
+            }
+        }
+        maxError = std::max(maxError, std::abs(reference - std::complex<double>(streamed[m])));
+    }
+
+    // Prototype response relative to its DC gain of P, passband up to 0.8 of the
+    // cutoff and stopband from 1.2 of the cutoff to the upsampled Nyquist frequency
+    const double cutoff = 1.0 / (2.0 * std::max(m_interpolation, m_decimation));
+    const int gridPoints = 256;
+    double worstRipple = 0.0;
+    double worstStopband = 0.0;
+    for (int i = 0; i <= 2 * gridPoints; i++) {
+        const bool passband = i <= gridPoints;
+        const double frequency = passband ? 0.8 * cutoff * i / gridPoints
+                                          : 1.2 * cutoff + (0.5 - 1.2 * cutoff) * (i - gridPoints) / gridPoints;
+        std::complex<double> response(0.0, 0.0);
+        for (size_t k = 0; k < m_prototype.size(); k++) {
+            response += (double)m_prototype[k] * std::polar(1.0, -2.0 * M_PI * frequency * k);
+        }
+        const double gain = std::abs(response) / m_interpolation;
+        if (passband) {
+            worstRipple = std::max(worstRipple, std::fabs(20.0 * std::log10(gain)));
+        } else {
+            worstStopband = std::max(worstStopband, gain);
+        }
+    }
+
+    std::vector<std::complex<float>> out;
+    out.reserve(outputLength(count));
+    reset();
+    double t0 = monotonicSeconds();
+    process(in.data(), count, out);
+    flush(out);
+    double t1 = monotonicSeconds();
+    reset();
+
+    report << "Rational resampler " << m_interpolation << "/" << m_decimation << " (" << length() << " taps, "
+#ifdef FIR_NEON
+              << "NEON"
+#else
+              << "scalar"
+#endif
+              << "): max error vs reference " << maxError << ", passband ripple "
+              << worstRipple << " dB, stopband " << 20.0 * std::log10(worstStopband) << " dB, "
+              << (count / (t1 - t0)) * 1e-6 << " input Msamples/s" << std::endl;
+}
@@ -0,0 +1,134 @@
+#ifndef FIR_H
+#define FIR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <complex>
+#include <iosfwd>
+#include <vector>
+
+/*
+ * Root-raised-cosine taps, identical to MATLAB's rcosdesign(rolloff, span, sps, "sqrt"):
+ * span * sps + 1 taps normalised to unit energy. rolloff lies in [0, 1] and
+ * span * sps must be even.
+ */
+std::vector<float> designRootRaisedCosine(float rolloff, int span, int sps);
+
+/*
+ * Streaming decimating FIR filter for complex samples with real taps.
+ *
+ * Only every decimation-th output is computed, so the cost is one tap per
+ * input sample per decimation factor, the same as a polyphase bank. Each output
+ * is one contiguous dot product of the reversed taps with the deinterleaved
+ * I and Q history, four taps per NEON multiply-accumulate on ARM. The history
+ * is kept between process() calls, so a capture can be filtered batch by batch.
+ */
+class FirDecimator {
+public:
+    FirDecimator(const std::vector<float>& taps, size_t decimation);
+
+    size_t length() const { return m_tapCount; }
+    size_t decimation() const { return m_decimation; }
+    // Group delay of a symmetric filter, in input samples
+    size_t delay() const { return (m_tapCount - 1) / 2; }
+
+    /*
+     * Clear the history.
+     * @param firstOutput - Input index (counted from the reset) of the first output sample;
+     *                      delay() gives output aligned like MATLAB's conv() with the delay trimmed
+     */
+    void reset(size_t firstOutput);
+
+    /*
+     * Filter a block of input samples.
+     * @param in - Input samples
+     * @param count - Number of input samples
+     * @param out - Decimated outputs are appended here
+     */
+    void process(const std::complex<float>* in, size_t count, std::vector<std::complex<float>>& out);
+
+    /*
+     * Filter a whole capture with the group delay removed: one output every decimation
+     * samples starting at input 0, aligned with the input, ceil(count / decimation) outputs.
+     */
+    void filterAligned(const std::complex<float>* in, size_t count, std::vector<std::complex<float>>& out);
+
+    // Time the kernel on noise and report input Msamples/s
+    void benchmark(size_t count, std::ostream& report);
+
+private:
+    std::vector<float> m_taps;      // Reversed, zero-padded at the front to a multiple of four
+    size_t m_tapCount;
+    size_t m_decimation;
+    size_t m_skip;                  // Inputs to consume before the next output
+    std::vector<float> m_real;      // History plus the current block
+    std::vector<float> m_imag;
+};
+
+/*
+ * Anti-imaging filter of MATLAB's resample(x, P, Q) with its defaults: a Kaiser
+ * (beta 5) windowed sinc of 20 * max(P, Q) + 1 taps with cutoff 1 / (2 * max(P, Q))
+ * at the upsampled rate, scaled to a DC gain of P.
+ */
+std::vector<float> designResampleFilter(size_t interpolation, size_t decimation);
+
+/*
+ * Streaming polyphase rational resampler for complex samples, equivalent to
+ * MATLAB's resample(x, P, Q).
+ *
+ * The prototype filter is split into P phases. Each output picks the phase and
+ * the input sample it lands on and computes one dot product with that phase,
+ * so none of the zero-stuffed samples is ever multiplied. Outputs are aligned
+ * like resample(): the filter delay is removed and output m sits at input time
+ * m * Q / P. History and output phase are kept between process() calls, so a
+ * capture can be resampled batch by batch.
+ */
+class RationalResampler {
+public:
+    // The ratio is reduced to lowest terms
+    RationalResampler(size_t interpolation, size_t decimation);
+
+    size_t interpolation() const { return m_interpolation; }
+    size_t decimation() const { return m_decimation; }
+    size_t length() const { return m_prototype.size(); }
+    // Output count of resample() for a given input count, ceil(inputs * P / Q)
+    size_t outputLength(size_t inputs) const {
+        return (inputs * m_interpolation + m_decimation - 1) / m_decimation;
+    }
+
+    // Clear the history and restart at input 0
+    void reset();
+
+    /*
+     * Resample a block of input samples.
+     * @param in - Input samples
+     * @param count - Number of input samples
+     * @param out - Outputs that only depend on inputs seen so far are appended here
+     */
+    void process(const std::complex<float>* in, size_t count, std::vector<std::complex<float>>& out);
+
+    // Append the outputs still owed after the last input, up to outputLength() of all inputs since reset()
+    void flush(std::vector<std::complex<float>>& out);
+
+    /*
+     * Compare against a zero-stuff, full-convolution reference and report the
+     * largest output error, the prototype's passband ripple and stopband
+     * attenuation, and the input Msamples/s of the streaming kernel on noise.
+     */
+    void benchmark(size_t count, std::ostream& report);
+
+private:
+    size_t m_interpolation;
+    size_t m_decimation;
+    size_t m_delay;                 // Prototype group delay at the upsampled rate
+    size_t m_phaseLength;           // Taps per phase, padded to a multiple of four
+    std::vector<float> m_prototype;
+    std::vector<float> m_phases;    // P phases of reversed, front-padded taps
+    uint64_t m_time;                // Upsampled time of the next output, relative to the current block
+    uint64_t m_inputs;              // Inputs since reset()
+    uint64_t m_outputs;             // Outputs since reset()
+    std::vector<float> m_real;      // History plus the current block
+    std::vector<float> m_imag;
+};
+
+#endif // FIR_H
@@ -0,0 +1,245 @@
+#include "iqcodec.h"
+
+#include <string.h>
+#include <algorithm>
+
+#define PREDICTOR_BITS 2
+#define RICE_BITS 4
+#define PREDICTORS 3
+
+// Longest coded residual: the escaped one, as IQCODEC_ESCAPE_BITS is above IQCODEC_MAX_RICE
+#define MAX_RESIDUAL_BITS (IQCODEC_ESCAPE + 1 + IQCODEC_ESCAPE_BITS)
+
+// Bits in flight are kept in a 64-bit accumulator and written 32 at a time
+class BitWriter {
+public:
+    explicit BitWriter(uint8_t* out) : m_out(out), m_begin(out), m_acc(0), m_bits(0) {}
+
+    // value must fit in bits, at most 32
+    void put(uint32_t value, unsigned bits) {
+        m_acc |= (uint64_t)value << m_bits;
+        m_bits += bits;
+        if (m_bits >= 32) {
+            uint32_t low = (uint32_t)m_acc;
+            memcpy(m_out, &low, sizeof(low));
+            m_out += sizeof(low);
+            m_acc >>= 32;
+            m_bits -= 32;
+        }
+    }
+
+    // Write out the partial last bytes; returns the stream length
+    size_t finish() {
+        while (m_bits > 0) {
+            *m_out++ = (uint8_t)m_acc;
+            m_acc >>= 8;
+            m_bits = m_bits > 8 ? m_bits - 8 : 0;
+        }
+        return m_out - m_begin;
+    }
+
+private:
+    uint8_t* m_out;
+    uint8_t* m_begin;
+    uint64_t m_acc;
+    unsigned m_bits;
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t* in, size_t length) : m_in(in), m_end(in + length), m_acc(0), m_bits(0) {}
+
+    // Top the accumulator up to at least 56 bits, or to the end of the stream
+    void refill() {
+        if (m_end - m_in >= 8) {
+            // Bytes that do not fit whole are read again, at the same position, next time
+            uint64_t next;
+            memcpy(&next, m_in, sizeof(next));
+            m_acc |= next << m_bits;
+            unsigned bytes = (63 - m_bits) >> 3;
+            m_in += bytes;
+            m_bits += bytes * 8;
+        } else {
+            while (m_bits <= 56 && m_in < m_end) {
+                m_acc |= (uint64_t)*m_in++ << m_bits;
+                m_bits += 8;
+            }
+        }
+    }
+
+    unsigned available() const { return m_bits; }
+    uint64_t peek() const { return m_acc; }
+
+    uint32_t get(unsigned bits) {
+        uint32_t value = (uint32_t)(m_acc & ((1ull << bits) - 1));
+        m_acc >>= bits;
+        m_bits -= bits;
+        return value;
+    }
+
+private:
+    const uint8_t* m_in;
+    const uint8_t* m_end;
+    uint64_t m_acc;
+    unsigned m_bits;
+};
+
+static inline uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// Prediction of the next code from the last two: none, first or second order difference
+static inline int32_t predict(int predictor, int32_t last, int32_t beforeLast) {
+    switch (predictor) {
+    case 1:
+        return last;
+    case 2:
+        return 2 * last - beforeLast;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Code one channel of a block.
+ * @param history - Last and second to last code of the channel, updated
+ */
+static void encodeChannel(BitWriter& writer, const int32_t* codes, size_t count, int32_t history[2]) {
+    // Residual sums of all predictors in one pass
+    uint64_t sums[PREDICTORS] = { 0, 0, 0 };
+    int32_t last = history[0];
+    int32_t beforeLast = history[1];
+    for (size_t n = 0; n < count; n++) {
+        int32_t code = codes[n];
+        sums[0] += zigzag(code);
+        sums[1] += zigzag(code - last);
+        sums[2] += zigzag(code - 2 * last + beforeLast);
+        beforeLast = last;
+        last = code;
+    }
+    int predictor = std::min_element(sums, sums + PREDICTORS) - sums;
+
+    // Rice parameter near log2 of the mean residual
+    unsigned rice = 0;
+    while (rice < IQCODEC_MAX_RICE && ((uint64_t)count << (rice + 1)) <= sums[predictor]) {
+        rice++;
+    }
+    writer.put(predictor, PREDICTOR_BITS);
+    writer.put(rice, RICE_BITS);
+
+    const uint32_t remainderMask = (1u << rice) - 1;
+    last = history[0];
+    beforeLast = history[1];
+    for (size_t n = 0; n < count; n++) {
+        int32_t code = codes[n];
+        uint32_t residual = zigzag(code - predict(predictor, last, beforeLast));
+        uint32_t quotient = residual >> rice;
+        if (quotient < IQCODEC_ESCAPE) {
+            writer.put((1u << quotient) | ((residual & remainderMask) << (quotient + 1)), quotient + 1 + rice);
+        } else {
+            writer.put(1u << IQCODEC_ESCAPE, IQCODEC_ESCAPE + 1);
+            writer.put(residual, IQCODEC_ESCAPE_BITS);
+        }
+        beforeLast = last;
+        last = code;
+    }
+    history[0] = last;
+    history[1] = beforeLast;
+}
+
+static bool decodeChannel(BitReader& reader, size_t count, int32_t history[2], int16_t* iq) {
+    reader.refill();
+    if (reader.available() < PREDICTOR_BITS + RICE_BITS) {
+        return false;
+    }
+    int predictor = reader.get(PREDICTOR_BITS);
+    unsigned rice = reader.get(RICE_BITS);
+    if (predictor >= PREDICTORS || rice > IQCODEC_MAX_RICE) {
+        return false;
+    }
+
+    int32_t last = history[0];
+    int32_t beforeLast = history[1];
+    for (size_t n = 0; n < count; n++) {
+        if (reader.available() < MAX_RESIDUAL_BITS) {
+            reader.refill();
+        }
+        uint64_t bits = reader.peek() & ((1ull << (IQCODEC_ESCAPE + 1)) - 1);
+        if (bits == 0) {
+            return false;
+        }
+        unsigned quotient = __builtin_ctzll(bits);
+        uint32_t residual;
+        if (quotient == IQCODEC_ESCAPE) {
+            if (reader.available() < IQCODEC_ESCAPE + 1 + IQCODEC_ESCAPE_BITS) {
+                return false;
+            }
+            reader.get(IQCODEC_ESCAPE + 1);
+            residual = reader.get(IQCODEC_ESCAPE_BITS);
+        } else {
+            if (reader.available() < quotient + 1 + rice) {
+                return false;
+            }
+            reader.get(quotient + 1);
+            residual = (quotient << rice) | reader.get(rice);
+        }
+        int32_t code = unzigzag(residual) + predict(predictor, last, beforeLast);
+        iq[2 * n] = (int16_t)code;
+        beforeLast = last;
+        last = code;
+    }
+    history[0] = last;
+    history[1] = beforeLast;
+    return true;
+}
+
+template <typename CodeOf>
+static size_t encode(size_t pairs, std::vector<uint8_t>& out, CodeOf codeOf) {
+    const size_t blocks = (pairs + IQCODEC_BLOCK_PAIRS - 1) / IQCODEC_BLOCK_PAIRS;
+    out.resize((pairs * 2 * MAX_RESIDUAL_BITS + blocks * 2 * (PREDICTOR_BITS + RICE_BITS)) / 8 + 8);
+    BitWriter writer(out.data());
+
+    int32_t history[2][2] = { { 0, 0 }, { 0, 0 } };
+    int32_t codes[2][IQCODEC_BLOCK_PAIRS];
+    for (size_t start = 0; start < pairs; start += IQCODEC_BLOCK_PAIRS) {
+        size_t count = std::min((size_t)IQCODEC_BLOCK_PAIRS, pairs - start);
+        for (size_t n = 0; n < count; n++) {
+            codeOf(start + n, codes[0][n], codes[1][n]);
+        }
+        encodeChannel(writer, codes[0], count, history[0]);
+        encodeChannel(writer, codes[1], count, history[1]);
+    }
+    out.resize(writer.finish());
+    return out.size();
+}
+
+size_t iqEncodeWords(const uint32_t* words, size_t pairs, std::vector<uint8_t>& out) {
+    return encode(pairs, out, [words](size_t n, int32_t& i, int32_t& q) {
+        i = (int32_t)words[n] >> 18;
+        q = (int32_t)(words[n] << 16) >> 18;
+    });
+}
+
+size_t iqEncodeCodes(const int16_t* iq, size_t pairs, std::vector<uint8_t>& out) {
+    return encode(pairs, out, [iq](size_t n, int32_t& i, int32_t& q) {
+        i = iq[2 * n];
+        q = iq[2 * n + 1];
+    });
+}
+
+bool iqDecode(const uint8_t* in, size_t length, size_t pairs, int16_t* iq) {
+    BitReader reader(in, length);
+    int32_t history[2][2] = { { 0, 0 }, { 0, 0 } };
+    for (size_t start = 0; start < pairs; start += IQCODEC_BLOCK_PAIRS) {
+        size_t count = std::min((size_t)IQCODEC_BLOCK_PAIRS, pairs - start);
+        if (!decodeChannel(reader, count, history[0], iq + 2 * start) ||
+            !decodeChannel(reader, count, history[1], iq + 2 * start + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
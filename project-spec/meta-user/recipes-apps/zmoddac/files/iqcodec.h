@@ -0,0 +1,50 @@
+#ifndef IQCODEC_H
+#define IQCODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Lossless codec for signed 14-bit I/Q codes.
+ *
+ * Pairs are coded in blocks of IQCODEC_BLOCK_PAIRS. For each block and
+ * channel the encoder picks the predictor (none, first or second order
+ * difference, continuing from the previous block) with the smallest residual
+ * sum and a Rice parameter from the mean residual. The block starts with the
+ * 2-bit predictor and the 4-bit parameter, followed by the zigzag-mapped
+ * residuals, all I residuals before all Q residuals. A residual is coded as
+ * its quotient in unary (zeros ended by a one) and the parameter's low bits;
+ * a quotient of IQCODEC_ESCAPE or more is sent as IQCODEC_ESCAPE zeros, a one
+ * and the residual in IQCODEC_ESCAPE_BITS bits.
+ *
+ * Bits are written LSB first into little-endian bytes; the stream is padded
+ * to whole bytes at its end only. The pair count is not part of the stream.
+ * Like packed14, the module only depends on the C++ standard library, so
+ * clients can build it to decode replies.
+ */
+
+#define IQCODEC_BLOCK_PAIRS 256
+#define IQCODEC_ESCAPE 16
+#define IQCODEC_ESCAPE_BITS 18
+#define IQCODEC_MAX_RICE 15
+
+/*
+ * Encode ZMOD DMA words (I in bits [31:18], Q in bits [15:2]).
+ * @param out - Replaced by the coded stream
+ * @return Coded length in bytes
+ */
+size_t iqEncodeWords(const uint32_t* words, size_t pairs, std::vector<uint8_t>& out);
+
+// Encode interleaved I, Q codes, which must lie in [-8192, 8191]
+size_t iqEncodeCodes(const int16_t* iq, size_t pairs, std::vector<uint8_t>& out);
+
+/*
+ * Decode a stream into interleaved I, Q codes.
+ * @param length - Bytes of the coded stream
+ * @param pairs - Number of pairs the stream holds
+ * @return false when the stream ends early or is corrupt
+ */
+bool iqDecode(const uint8_t* in, size_t length, size_t pairs, int16_t* iq);
+
+#endif // IQCODEC_H
@@ -0,0 +1,372 @@
+#include "iqconvert.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define IQCONVERT_NEON 1
+#endif
+
+#include "zmodlib/ZmodADC1410/zmodadc1410.h"
+#include "zmodlib/ZmodDAC1411/zmoddac1411.h"
+
+#include "benchutil.h"
+
+// Bit positions of the two signed 14-bit channels in a packed DMA word
+#define ADC_CH1_SHIFT 18
+#define ADC_CH2_SHIFT 2
+#define DAC_CH1_SHIFT 18
+#define DAC_CH2_SHIFT 2
+#define DAC_CH2_MASK 0x0000FFFC
+
+// Signed 14-bit DAC code range
+#define DAC_CODE_MAX 8191
+#define DAC_CODE_MIN (-8192)
+
+// Word seed of the ADC conversion benchmark
+#define ADC_BENCH_SEED 0x12345678
+
+AdcIqConverter::AdcIqConverter(ZMODADC1410* adc, uint8_t gain, float scaling)
+    : m_adc(adc), m_gain(gain), m_scaling(scaling), m_vectorized(true) {
+    m_offset = m_adc->getVoltFromSignedRaw(0, gain) * scaling;
+    m_scale = m_adc->getVoltFromSignedRaw(1, gain) * scaling - m_offset;
+
+    // Probe words covering both rails, zero, +/-1 and mixed channel patterns
+    const uint32_t probes[] = {
+        0x00000000, 0xFFFFFFFF, 0x7FFC7FFC, 0x80008000, 0x00040004,
+        0xFFFCFFFC, 0x1234ABCD, 0xDEADBEEF, 0x80007FFC, 0x7FFC8000
+    };
+    const size_t probeCount = sizeof(probes) / sizeof(probes[0]);
+    float kernelI[probeCount], kernelQ[probeCount];
+    float libraryI[probeCount], libraryQ[probeCount];
+    convertKernel(probes, probeCount, kernelI, kernelQ);
+    convertLibrary(probes, probeCount, libraryI, libraryQ);
+
+    for (size_t n = 0; n < probeCount; n++) {
+        float tolI = 1e-5f * std::max(1.0f, std::fabs(libraryI[n]));
+        float tolQ = 1e-5f * std::max(1.0f, std::fabs(libraryQ[n]));
+        if (std::fabs(kernelI[n] - libraryI[n]) > tolI || std::fabs(kernelQ[n] - libraryQ[n]) > tolQ) {
+            std::cerr << "ADC conversion kernel disagrees with zmodlib for word 0x" << std::hex
+                      << probes[n] << std::dec << ", using per-sample conversion" << std::endl;
+            m_vectorized = false;
+            break;
+        }
+    }
+}
+
+void AdcIqConverter::convert(const uint32_t* words, size_t count, float* i, float* q) const {
+    if (m_vectorized) {
+        convertKernel(words, count, i, q);
+    } else {
+        convertLibrary(words, count, i, q);
+    }
+}
+
+void AdcIqConverter::convertComplex(const uint32_t* words, size_t count, std::complex<float>* out) const {
+    // std::complex<float> is laid out as two floats, real then imaginary
+    float* iq = reinterpret_cast<float*>(out);
+    size_t n = 0;
+
+    if (!m_vectorized) {
+        for (; n < count; n++) {
+            int16_t realRaw = m_adc->signedChannelData(0, words[n]);
+            int16_t imagRaw = m_adc->signedChannelData(1, words[n]);
+            iq[2 * n] = m_adc->getVoltFromSignedRaw(realRaw, m_gain) * m_scaling;
+            iq[2 * n + 1] = m_adc->getVoltFromSignedRaw(imagRaw, m_gain) * m_scaling;
+        }
+        return;
+    }
+
+#ifdef IQCONVERT_NEON
+    const float32x4_t vScale = vdupq_n_f32(m_scale);
+    const float32x4_t vOffset = vdupq_n_f32(m_offset);
+    for (; n + 4 <= count; n += 4) {
+        int32x4_t w = vreinterpretq_s32_u32(vld1q_u32(words + n));
+        int32x4_t rawI = vshrq_n_s32(w, ADC_CH1_SHIFT);
+        int32x4_t rawQ = vshrq_n_s32(vshlq_n_s32(w, 16), 16 + ADC_CH2_SHIFT);
+        float32x4x2_t sample;
+        sample.val[0] = vmlaq_f32(vOffset, vcvtq_f32_s32(rawI), vScale);
+        sample.val[1] = vmlaq_f32(vOffset, vcvtq_f32_s32(rawQ), vScale);
+        // VST2 interleaves the I and Q lanes on the way out
+        vst2q_f32(iq + 2 * n, sample);
+    }
+#endif
+
+    for (; n < count; n++) {
+        int32_t w = (int32_t)words[n];
+        int32_t rawI = w >> ADC_CH1_SHIFT;
+        int32_t rawQ = (int32_t)((uint32_t)w << 16) >> (16 + ADC_CH2_SHIFT);
+        iq[2 * n] = (float)rawI * m_scale + m_offset;
+        iq[2 * n + 1] = (float)rawQ * m_scale + m_offset;
+    }
+}
+
+void AdcIqConverter::unpackRaw(const uint32_t* words, size_t count, int16_t* iq) const {
+    size_t n = 0;
+
+#ifdef IQCONVERT_NEON
+    for (; n + 4 <= count; n += 4) {
+        int32x4_t w = vreinterpretq_s32_u32(vld1q_u32(words + n));
+        int16x4x2_t raw;
+        raw.val[0] = vmovn_s32(vshrq_n_s32(w, ADC_CH1_SHIFT));
+        raw.val[1] = vmovn_s32(vshrq_n_s32(vshlq_n_s32(w, 16), 16 + ADC_CH2_SHIFT));
+        vst2_s16(iq + 2 * n, raw);
+    }
+#endif
+
+    for (; n < count; n++) {
+        int32_t w = (int32_t)words[n];
+        iq[2 * n] = (int16_t)(w >> ADC_CH1_SHIFT);
+        iq[2 * n + 1] = (int16_t)((int32_t)((uint32_t)w << 16) >> (16 + ADC_CH2_SHIFT));
+    }
+}
+
+void AdcIqConverter::convertLibrary(const uint32_t* words, size_t count, float* i, float* q) const {
+    for (size_t n = 0; n < count; n++) {
+        int16_t realRaw = m_adc->signedChannelData(0, words[n]);
+        int16_t imagRaw = m_adc->signedChannelData(1, words[n]);
+        i[n] = m_adc->getVoltFromSignedRaw(realRaw, m_gain) * m_scaling;
+        q[n] = m_adc->getVoltFromSignedRaw(imagRaw, m_gain) * m_scaling;
+    }
+}
+
+void AdcIqConverter::convertKernel(const uint32_t* words, size_t count, float* i, float* q) const {
+    size_t n = 0;
+
+#ifdef IQCONVERT_NEON
+    const float32x4_t vScale = vdupq_n_f32(m_scale);
+    const float32x4_t vOffset = vdupq_n_f32(m_offset);
+    for (; n + 4 <= count; n += 4) {
+        int32x4_t w = vreinterpretq_s32_u32(vld1q_u32(words + n));
+        // Arithmetic right shifts sign-extend the 14-bit fields
+        int32x4_t rawI = vshrq_n_s32(w, ADC_CH1_SHIFT);
+        int32x4_t rawQ = vshrq_n_s32(vshlq_n_s32(w, 16), 16 + ADC_CH2_SHIFT);
+#if defined(__ARM_FEATURE_FMA)
+        vst1q_f32(i + n, vfmaq_f32(vOffset, vcvtq_f32_s32(rawI), vScale));
+        vst1q_f32(q + n, vfmaq_f32(vOffset, vcvtq_f32_s32(rawQ), vScale));
+#else
+        // Cortex-A9 has no fused VFMA; VMLA is the single-instruction multiply-add
+        vst1q_f32(i + n, vmlaq_f32(vOffset, vcvtq_f32_s32(rawI), vScale));
+        vst1q_f32(q + n, vmlaq_f32(vOffset, vcvtq_f32_s32(rawQ), vScale));
+#endif
+    }
+#endif
+
+    for (; n < count; n++) {
+        int32_t w = (int32_t)words[n];
+        int32_t rawI = w >> ADC_CH1_SHIFT;
+        int32_t rawQ = (int32_t)((uint32_t)w << 16) >> (16 + ADC_CH2_SHIFT);
+        i[n] = (float)rawI * m_scale + m_offset;
+        q[n] = (float)rawQ * m_scale + m_offset;
+    }
+}
+
+void AdcIqConverter::benchmark(size_t count, std::ostream& report) const {
+    std::vector<uint32_t> words(count);
+    fillRandomWords(words.data(), count, ADC_BENCH_SEED);
+    std::vector<float> i(count), q(count);
+
+    double t0 = monotonicSeconds();
+    convertLibrary(words.data(), count, i.data(), q.data());
+    double t1 = monotonicSeconds();
+    convertKernel(words.data(), count, i.data(), q.data());
+    double t2 = monotonicSeconds();
+
+    report << "ADC conversion (" << count << " samples): per-sample "
+              << (count / (t1 - t0)) * 1e-6 << " Msamples/s, bulk"
+#ifdef IQCONVERT_NEON
+              << " NEON "
+#else
+              << " scalar "
+#endif
+              << (count / (t2 - t1)) * 1e-6 << " Msamples/s"
+              << (m_vectorized ? "" : " (bulk kernel disabled)") << std::endl;
+}
+
+DacIqPacker::DacIqPacker(ZMODDAC1411* dac, uint8_t gain)
+    : m_dac(dac), m_gain(gain), m_codesPerVolt(0.0f), m_vectorized(true) {
+    // Find the voltage where the truncated code reaches half scale; the library
+    // map is linear, so that fixes the volt-to-code gain.
+    const int32_t halfScale = (DAC_CODE_MAX + 1) / 2;
+    double high = 1e-3;
+    while (m_dac->getSignedRawFromVolt((float)high, gain) < halfScale && high < 1e6) {
+        high *= 2.0;
+    }
+    double low = 0.0;
+    for (int iter = 0; iter < 64; iter++) {
+        double mid = 0.5 * (low + high);
+        if (m_dac->getSignedRawFromVolt((float)mid, gain) >= halfScale) {
+            high = mid;
+        } else {
+            low = mid;
+        }
+    }
+    m_codesPerVolt = (float)(halfScale / high);
+
+    // Probe values: zero, fractions of a code, mid-scale and both rails
+    const float fullScale = DAC_CODE_MAX / m_codesPerVolt;
+    const float probes[] = {
+        0.0f, 0.4f / m_codesPerVolt, -0.4f / m_codesPerVolt, 1.7f / m_codesPerVolt,
+        -1.7f / m_codesPerVolt, 0.3f * fullScale, -0.55f * fullScale,
+        0.999f * fullScale, -0.999f * fullScale, 2.0f * fullScale, -2.0f * fullScale
+    };
+    const size_t probeCount = sizeof(probes) / sizeof(probes[0]);
+    uint32_t kernelWords[probeCount];
+    uint32_t libraryWords[probeCount];
+    float reversed[probeCount];
+    for (size_t n = 0; n < probeCount; n++) {
+        reversed[n] = probes[probeCount - 1 - n];
+    }
+    packKernel(probes, reversed, probeCount, kernelWords);
+    packLibrary(probes, reversed, probeCount, libraryWords);
+
+    for (size_t n = 0; n < probeCount; n++) {
+        if (kernelWords[n] != libraryWords[n]) {
+            std::cerr << "DAC packing kernel disagrees with zmodlib for " << probes[n] << " V / "
+                      << reversed[n] << " V, using per-sample conversion" << std::endl;
+            m_vectorized = false;
+            break;
+        }
+    }
+}
+
+void DacIqPacker::pack(const float* i, const float* q, size_t count, uint32_t* out) const {
+    if (m_vectorized) {
+        packKernel(i, q, count, out);
+    } else {
+        packLibrary(i, q, count, out);
+    }
+}
+
+void DacIqPacker::packInterleaved(const float* iq, size_t count, uint32_t* out) const {
+    size_t n = 0;
+
+    if (!m_vectorized) {
+        for (; n < count; n++) {
+            int16_t realRaw = m_dac->getSignedRawFromVolt(iq[2 * n], m_gain);
+            int16_t imagRaw = m_dac->getSignedRawFromVolt(iq[2 * n + 1], m_gain);
+            out[n] = m_dac->arrangeChannelData(0, realRaw) | m_dac->arrangeChannelData(1, imagRaw);
+        }
+        return;
+    }
+
+#ifdef IQCONVERT_NEON
+    const float32x4_t vGain = vdupq_n_f32(m_codesPerVolt);
+    const int32x4_t vMax = vdupq_n_s32(DAC_CODE_MAX);
+    const int32x4_t vMin = vdupq_n_s32(DAC_CODE_MIN);
+    const uint32x4_t vMask = vdupq_n_u32(DAC_CH2_MASK);
+    for (; n + 4 <= count; n += 4) {
+        // VLD2 splits the I and Q lanes on the way in
+        float32x4x2_t sample = vld2q_f32(iq + 2 * n);
+        int32x4_t rawI = vcvtq_s32_f32(vmulq_f32(sample.val[0], vGain));
+        int32x4_t rawQ = vcvtq_s32_f32(vmulq_f32(sample.val[1], vGain));
+        rawI = vmaxq_s32(vminq_s32(rawI, vMax), vMin);
+        rawQ = vmaxq_s32(vminq_s32(rawQ, vMax), vMin);
+        uint32x4_t wordI = vreinterpretq_u32_s32(vshlq_n_s32(rawI, DAC_CH1_SHIFT));
+        uint32x4_t wordQ = vandq_u32(vreinterpretq_u32_s32(vshlq_n_s32(rawQ, DAC_CH2_SHIFT)), vMask);
+        vst1q_u32(out + n, vorrq_u32(wordI, wordQ));
+    }
+#endif
+
+    for (; n < count; n++) {
+        float scaledI = std::min(std::max(iq[2 * n] * m_codesPerVolt, (float)DAC_CODE_MIN), (float)DAC_CODE_MAX);
+        float scaledQ = std::min(std::max(iq[2 * n + 1] * m_codesPerVolt, (float)DAC_CODE_MIN), (float)DAC_CODE_MAX);
+        int32_t rawI = (int32_t)scaledI;
+        int32_t rawQ = (int32_t)scaledQ;
+        out[n] = ((uint32_t)rawI << DAC_CH1_SHIFT) | (((uint32_t)rawQ << DAC_CH2_SHIFT) & DAC_CH2_MASK);
+    }
+}
+
+void DacIqPacker::packRaw(const int16_t* iq, size_t count, uint32_t* out) const {
+    size_t n = 0;
+
+#ifdef IQCONVERT_NEON
+    const int32x4_t vMax = vdupq_n_s32(DAC_CODE_MAX);
+    const int32x4_t vMin = vdupq_n_s32(DAC_CODE_MIN);
+    const uint32x4_t vMask = vdupq_n_u32(DAC_CH2_MASK);
+    for (; n + 4 <= count; n += 4) {
+        // Four pairs are loaded before their four words are stored, so in-place packing is safe
+        int16x4x2_t raw = vld2_s16(iq + 2 * n);
+        int32x4_t rawI = vmaxq_s32(vminq_s32(vmovl_s16(raw.val[0]), vMax), vMin);
+        int32x4_t rawQ = vmaxq_s32(vminq_s32(vmovl_s16(raw.val[1]), vMax), vMin);
+        uint32x4_t wordI = vreinterpretq_u32_s32(vshlq_n_s32(rawI, DAC_CH1_SHIFT));
+        uint32x4_t wordQ = vandq_u32(vreinterpretq_u32_s32(vshlq_n_s32(rawQ, DAC_CH2_SHIFT)), vMask);
+        vst1q_u32(out + n, vorrq_u32(wordI, wordQ));
+    }
+#endif
+
+    for (; n < count; n++) {
+        int32_t rawI = std::min(std::max((int32_t)iq[2 * n], DAC_CODE_MIN), DAC_CODE_MAX);
+        int32_t rawQ = std::min(std::max((int32_t)iq[2 * n + 1], DAC_CODE_MIN), DAC_CODE_MAX);
+        out[n] = ((uint32_t)rawI << DAC_CH1_SHIFT) | (((uint32_t)rawQ << DAC_CH2_SHIFT) & DAC_CH2_MASK);
+    }
+}
+
+void DacIqPacker::packLibrary(const float* i, const float* q, size_t count, uint32_t* out) const {
+    for (size_t n = 0; n < count; n++) {
+        int16_t realRaw = m_dac->getSignedRawFromVolt(i[n], m_gain);
+        int16_t imagRaw = m_dac->getSignedRawFromVolt(q[n], m_gain);
+        out[n] = m_dac->arrangeChannelData(0, realRaw) | m_dac->arrangeChannelData(1, imagRaw);
+    }
+}
+
+void DacIqPacker::packKernel(const float* i, const float* q, size_t count, uint32_t* out) const {
+    size_t n = 0;
+
+#ifdef IQCONVERT_NEON
+    const float32x4_t vGain = vdupq_n_f32(m_codesPerVolt);
+    const int32x4_t vMax = vdupq_n_s32(DAC_CODE_MAX);
+    const int32x4_t vMin = vdupq_n_s32(DAC_CODE_MIN);
+    const uint32x4_t vMask = vdupq_n_u32(DAC_CH2_MASK);
+    for (; n + 4 <= count; n += 4) {
+        // VCVT truncates toward zero and saturates, like the library's (int32_t) cast
+        int32x4_t rawI = vcvtq_s32_f32(vmulq_f32(vld1q_f32(i + n), vGain));
+        int32x4_t rawQ = vcvtq_s32_f32(vmulq_f32(vld1q_f32(q + n), vGain));
+        rawI = vmaxq_s32(vminq_s32(rawI, vMax), vMin);
+        rawQ = vmaxq_s32(vminq_s32(rawQ, vMax), vMin);
+        uint32x4_t wordI = vreinterpretq_u32_s32(vshlq_n_s32(rawI, DAC_CH1_SHIFT));
+        uint32x4_t wordQ = vandq_u32(vreinterpretq_u32_s32(vshlq_n_s32(rawQ, DAC_CH2_SHIFT)), vMask);
+        vst1q_u32(out + n, vorrq_u32(wordI, wordQ));
+    }
+#endif
+
+    for (; n < count; n++) {
+        float scaledI = i[n] * m_codesPerVolt;
+        float scaledQ = q[n] * m_codesPerVolt;
+        // Saturate in float first so the integer cast cannot overflow
+        scaledI = std::min(std::max(scaledI, (float)DAC_CODE_MIN), (float)DAC_CODE_MAX);
+        scaledQ = std::min(std::max(scaledQ, (float)DAC_CODE_MIN), (float)DAC_CODE_MAX);
+        int32_t rawI = (int32_t)scaledI;
+        int32_t rawQ = (int32_t)scaledQ;
+        out[n] = ((uint32_t)rawI << DAC_CH1_SHIFT) | (((uint32_t)rawQ << DAC_CH2_SHIFT) & DAC_CH2_MASK);
+    }
+}
+
+void DacIqPacker::benchmark(size_t count, std::ostream& report) const {
+    std::vector<float> i(count), q(count);
+    const float fullScale = DAC_CODE_MAX / m_codesPerVolt;
+    for (size_t n = 0; n < count; n++) {
+        i[n] = fullScale * std::sin(0.001f * n);
+        q[n] = fullScale * std::cos(0.001f * n);
+    }
+    std::vector<uint32_t> words(count);
+
+    double t0 = monotonicSeconds();
+    packLibrary(i.data(), q.data(), count, words.data());
+    double t1 = monotonicSeconds();
+    packKernel(i.data(), q.data(), count, words.data());
+    double t2 = monotonicSeconds();
+
+    report << "DAC packing (" << count << " samples): per-sample "
+              << (count / (t1 - t0)) * 1e-6 << " Msamples/s, bulk"
+#ifdef IQCONVERT_NEON
+              << " NEON "
+#else
+              << " scalar "
+#endif
+              << (count / (t2 - t1)) * 1e-6 << " Msamples/s"
+              << (m_vectorized ? "" : " (bulk kernel disabled)") << std::endl;
+}
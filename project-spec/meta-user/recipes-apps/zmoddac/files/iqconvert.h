@@ -0,0 +1,129 @@
+#ifndef IQCONVERT_H
+#define IQCONVERT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <complex>
+#include <iosfwd>
+
+class ZMODADC1410;
+class ZMODDAC1411;
+
+/*
+ * Bulk conversion of packed ZmodADC1410 DMA words to calibrated I/Q floats.
+ *
+ * Each 32-bit word holds channel 1 (I) in bits [31:18] and channel 2 (Q) in
+ * bits [15:2] as signed 14-bit values. The linear volt scale and offset are
+ * taken from the library's getVoltFromSignedRaw() once, so every sample costs
+ * two shifts and one multiply-add. On ARM the loop runs four words per NEON
+ * iteration; other targets use the equivalent scalar loop.
+ *
+ * The constructor checks the kernel against signedChannelData() and
+ * getVoltFromSignedRaw() on a set of probe words. If they disagree the
+ * converter falls back to the per-sample library calls.
+ */
+class AdcIqConverter {
+public:
+    AdcIqConverter(ZMODADC1410* adc, uint8_t gain, float scaling);
+
+    /*
+     * Deinterleave and convert a block of DMA words.
+     * @param words - Packed ADC words
+     * @param count - Number of words
+     * @param i - Receives count channel 1 values in volts
+     * @param q - Receives count channel 2 values in volts
+     */
+    void convert(const uint32_t* words, size_t count, float* i, float* q) const;
+
+    /*
+     * Convert a block of DMA words to interleaved complex samples.
+     * @param words - Packed ADC words
+     * @param count - Number of words
+     * @param out - Receives count samples, I + jQ in volts
+     */
+    void convertComplex(const uint32_t* words, size_t count, std::complex<float>* out) const;
+
+    /*
+     * Extract the raw signed 14-bit codes of a block of DMA words, uncalibrated.
+     * @param words - Packed ADC words
+     * @param count - Number of words
+     * @param iq - Receives 2 * count codes, I and Q interleaved; volts = code * scale() + offset()
+     */
+    void unpackRaw(const uint32_t* words, size_t count, int16_t* iq) const;
+
+    bool vectorized() const { return m_vectorized; }
+    float scale() const { return m_scale; }
+    float offset() const { return m_offset; }
+
+    // Time the bulk kernel against the per-sample library calls and report Msamples/s
+    void benchmark(size_t count, std::ostream& report) const;
+
+private:
+    void convertLibrary(const uint32_t* words, size_t count, float* i, float* q) const;
+    void convertKernel(const uint32_t* words, size_t count, float* i, float* q) const;
+
+    ZMODADC1410* m_adc;
+    uint8_t m_gain;
+    float m_scaling;
+    float m_scale;
+    float m_offset;
+    bool m_vectorized;
+};
+
+/*
+ * Bulk packing of I/Q float waveforms into ZmodDAC1411 DMA words.
+ *
+ * Volts are converted with the same truncating linear map as the library's
+ * getSignedRawFromVolt(), saturated to the signed 14-bit range and packed as
+ * channel 1 (I) in bits [31:18] and channel 2 (Q) in bits [15:2], matching
+ * arrangeChannelData(). The volt-to-code gain is measured from the library
+ * once per instance and the result is verified against getSignedRawFromVolt()
+ * and arrangeChannelData() on probe values, with a per-sample fallback.
+ */
+class DacIqPacker {
+public:
+    DacIqPacker(ZMODDAC1411* dac, uint8_t gain);
+
+    /*
+     * Convert and pack a waveform straight into a DMA buffer.
+     * @param i - Channel 1 samples in volts
+     * @param q - Channel 2 samples in volts
+     * @param count - Number of samples
+     * @param out - Receives count packed DMA words
+     */
+    void pack(const float* i, const float* q, size_t count, uint32_t* out) const;
+
+    /*
+     * Convert and pack an interleaved waveform.
+     * @param iq - 2 * count values in volts, I and Q interleaved
+     * @param count - Number of samples
+     * @param out - Receives count packed DMA words
+     */
+    void packInterleaved(const float* iq, size_t count, uint32_t* out) const;
+
+    /*
+     * Pack raw DAC codes, saturated to the signed 14-bit range. Each I/Q pair
+     * is as wide as its DMA word, so iq may alias out and be packed in place.
+     * @param iq - 2 * count codes, I and Q interleaved
+     * @param count - Number of samples
+     * @param out - Receives count packed DMA words
+     */
+    void packRaw(const int16_t* iq, size_t count, uint32_t* out) const;
+
+    bool vectorized() const { return m_vectorized; }
+    float codesPerVolt() const { return m_codesPerVolt; }
+
+    // Time the bulk kernel against the per-sample library calls and report Msamples/s
+    void benchmark(size_t count, std::ostream& report) const;
+
+private:
+    void packLibrary(const float* i, const float* q, size_t count, uint32_t* out) const;
+    void packKernel(const float* i, const float* q, size_t count, uint32_t* out) const;
+
+    ZMODDAC1411* m_dac;
+    uint8_t m_gain;
+    float m_codesPerVolt;
+    bool m_vectorized;
+};
+
+#endif // IQCONVERT_H
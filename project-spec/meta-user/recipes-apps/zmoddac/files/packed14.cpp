@@ -0,0 +1,159 @@
+#include "packed14.h"
+
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PACKED14_NEON 1
+#endif
+
+// Bit positions of the two signed 14-bit channels in a ZMOD DMA word
+#define WORD_CH1_SHIFT 18
+#define WORD_CH2_SHIFT 2
+
+#define CODE_MASK 0x3FFFu
+#define PAIR_BITS 28
+#define PAIR_MASK 0x0FFFFFFFu
+
+// Bytes of two pairs, and of an odd final pair
+#define GROUP_BYTES 7
+#define TAIL_BYTES 4
+
+// The stream is little-endian, like the Zynq and the client hosts
+static inline void storeGroup(uint64_t group, uint8_t* out) {
+    memcpy(out, &group, GROUP_BYTES);
+}
+
+static inline uint64_t loadGroup(const uint8_t* in) {
+    uint64_t group = 0;
+    memcpy(&group, in, GROUP_BYTES);
+    return group;
+}
+
+static inline uint32_t pairFromWord(uint32_t word) {
+    return (word >> WORD_CH1_SHIFT) | (((word >> WORD_CH2_SHIFT) & CODE_MASK) << 14);
+}
+
+static inline uint32_t wordFromPair(uint32_t pair) {
+    return ((pair & CODE_MASK) << WORD_CH1_SHIFT) | (((pair >> 14) & CODE_MASK) << WORD_CH2_SHIFT);
+}
+
+static inline uint32_t pairFromCodes(int16_t i, int16_t q) {
+    return ((uint32_t)i & CODE_MASK) | (((uint32_t)q & CODE_MASK) << 14);
+}
+
+// Sign-extend a 14-bit field
+static inline int16_t codeFromField(uint32_t field) {
+    return (int16_t)((field & CODE_MASK) << 2) >> 2;
+}
+
+// Scalar packing of pairs [first, pairs); first must be even
+template <typename PairOf>
+static void packPairs(size_t first, size_t pairs, uint8_t* out, PairOf pairOf) {
+    uint8_t* bytes = out + first / 2 * GROUP_BYTES;
+    size_t n = first;
+    for (; n + 2 <= pairs; n += 2) {
+        storeGroup((uint64_t)pairOf(n) | ((uint64_t)pairOf(n + 1) << PAIR_BITS), bytes);
+        bytes += GROUP_BYTES;
+    }
+    if (n < pairs) {
+        uint32_t pair = pairOf(n);
+        memcpy(bytes, &pair, TAIL_BYTES);
+    }
+}
+
+// Scalar unpacking of pairs [first, pairs); first must be even
+template <typename Store>
+static void unpackPairs(const uint8_t* in, size_t first, size_t pairs, Store store) {
+    const uint8_t* bytes = in + first / 2 * GROUP_BYTES;
+    size_t n = first;
+    for (; n + 2 <= pairs; n += 2) {
+        uint64_t group = loadGroup(bytes);
+        store(n, (uint32_t)group & PAIR_MASK);
+        store(n + 1, (uint32_t)(group >> PAIR_BITS) & PAIR_MASK);
+        bytes += GROUP_BYTES;
+    }
+    if (n < pairs) {
+        uint32_t pair;
+        memcpy(&pair, bytes, TAIL_BYTES);
+        store(n, pair & PAIR_MASK);
+    }
+}
+
+#ifdef PACKED14_NEON
+// Fold four 28-bit pairs into two 7-byte groups
+static inline void storePairs4(uint32x4_t pairs, uint8_t* out) {
+    uint64x2_t lanes = vreinterpretq_u64_u32(pairs);
+    uint64x2_t groups = vsliq_n_u64(lanes, vshrq_n_u64(lanes, 32), PAIR_BITS);
+    storeGroup(vgetq_lane_u64(groups, 0), out);
+    storeGroup(vgetq_lane_u64(groups, 1), out + GROUP_BYTES);
+}
+
+// Split two 7-byte groups into four 28-bit pairs
+static inline uint32x4_t loadPairs4(const uint8_t* in) {
+    uint64x2_t groups = vcombine_u64(vcreate_u64(loadGroup(in)), vcreate_u64(loadGroup(in + GROUP_BYTES)));
+    uint32x2_t even = vand_u32(vmovn_u64(groups), vdup_n_u32(PAIR_MASK));
+    uint32x2_t odd = vshrn_n_u64(groups, PAIR_BITS);
+    uint32x2x2_t zipped = vzip_u32(even, odd);
+    return vcombine_u32(zipped.val[0], zipped.val[1]);
+}
+#endif
+
+void packWords14(const uint32_t* words, size_t pairs, uint8_t* out) {
+    size_t n = 0;
+#ifdef PACKED14_NEON
+    const uint32x4_t codeMask = vdupq_n_u32(CODE_MASK);
+    for (; n + 4 <= pairs; n += 4) {
+        uint32x4_t w = vld1q_u32(words + n);
+        uint32x4_t i = vshrq_n_u32(w, WORD_CH1_SHIFT);
+        uint32x4_t q = vandq_u32(vshrq_n_u32(w, WORD_CH2_SHIFT), codeMask);
+        storePairs4(vsliq_n_u32(i, q, 14), out + n / 2 * GROUP_BYTES);
+    }
+#endif
+    packPairs(n, pairs, out, [words](size_t k) { return pairFromWord(words[k]); });
+}
+
+void unpackWords14(const uint8_t* in, size_t pairs, uint32_t* words) {
+    size_t n = 0;
+#ifdef PACKED14_NEON
+    const uint32x4_t ch2Mask = vdupq_n_u32(CODE_MASK << WORD_CH2_SHIFT);
+    for (; n + 4 <= pairs; n += 4) {
+        uint32x4_t p = loadPairs4(in + n / 2 * GROUP_BYTES);
+        uint32x4_t i = vshlq_n_u32(p, WORD_CH1_SHIFT);
+        uint32x4_t q = vandq_u32(vshrq_n_u32(p, 14 - WORD_CH2_SHIFT), ch2Mask);
+        vst1q_u32(words + n, vorrq_u32(i, q));
+    }
+#endif
+    unpackPairs(in, n, pairs, [words](size_t k, uint32_t pair) { words[k] = wordFromPair(pair); });
+}
+
+void packCodes14(const int16_t* iq, size_t pairs, uint8_t* out) {
+    size_t n = 0;
+#ifdef PACKED14_NEON
+    const uint32x4_t codeMask = vdupq_n_u32(CODE_MASK);
+    for (; n + 4 <= pairs; n += 4) {
+        int16x4x2_t codes = vld2_s16(iq + 2 * n);
+        uint32x4_t i = vreinterpretq_u32_s32(vmovl_s16(codes.val[0]));
+        uint32x4_t q = vandq_u32(vreinterpretq_u32_s32(vmovl_s16(codes.val[1])), codeMask);
+        storePairs4(vsliq_n_u32(i, q, 14), out + n / 2 * GROUP_BYTES);
+    }
+#endif
+    packPairs(n, pairs, out, [iq](size_t k) { return pairFromCodes(iq[2 * k], iq[2 * k + 1]); });
+}
+
+void unpackCodes14(const uint8_t* in, size_t pairs, int16_t* iq) {
+    size_t n = 0;
+#ifdef PACKED14_NEON
+    for (; n + 4 <= pairs; n += 4) {
+        int32x4_t p = vreinterpretq_s32_u32(loadPairs4(in + n / 2 * GROUP_BYTES));
+        int16x4x2_t codes;
+        codes.val[0] = vmovn_s32(vshrq_n_s32(vshlq_n_s32(p, 18), 18));
+        codes.val[1] = vmovn_s32(vshrq_n_s32(vshlq_n_s32(p, 4), 18));
+        vst2_s16(iq + 2 * n, codes);
+    }
+#endif
+    unpackPairs(in, n, pairs, [iq](size_t k, uint32_t pair) {
+        iq[2 * k] = codeFromField(pair);
+        iq[2 * k + 1] = codeFromField(pair >> 14);
+    });
+}
@@ -0,0 +1,47 @@
+#ifndef PACKED14_H
+#define PACKED14_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * 14-bit packed I/Q wire format.
+ *
+ * Each I/Q pair takes 28 bits: I in bits [0, 14) and Q in bits [14, 28) of
+ * the pair, both signed 14-bit codes. Pairs follow each other in a
+ * little-endian bit stream, so two pairs fill exactly 7 bytes. An odd final
+ * pair takes 4 bytes with the top nibble zero.
+ *
+ * The module only depends on the C++ standard library, so clients can build
+ * packed14.cpp as it is to decode replies and encode uploads.
+ */
+
+// Largest code; the smallest is -PACKED14_CODE_MAX - 1
+#define PACKED14_CODE_MAX 8191
+
+// Bytes taken by pairs packed I/Q pairs
+inline size_t packed14Length(size_t pairs) {
+    return (pairs * 7 + 1) / 2;
+}
+
+/*
+ * Pack ZMOD DMA words (I in bits [31:18], Q in bits [15:2]) without
+ * going through signed codes; used for unprocessed ADC captures.
+ * @param words - pairs packed words
+ * @param out - Receives packed14Length(pairs) bytes
+ */
+void packWords14(const uint32_t* words, size_t pairs, uint8_t* out);
+
+// Unpack into ZMOD DMA words, e.g. straight into a DAC buffer
+void unpackWords14(const uint8_t* in, size_t pairs, uint32_t* words);
+
+/*
+ * Pack interleaved I, Q codes. Codes must already lie in [-8192, 8191];
+ * higher bits are dropped.
+ */
+void packCodes14(const int16_t* iq, size_t pairs, uint8_t* out);
+
+// Unpack into interleaved I, Q codes; the reference client decoder
+void unpackCodes14(const uint8_t* in, size_t pairs, int16_t* iq);
+
+#endif // PACKED14_H
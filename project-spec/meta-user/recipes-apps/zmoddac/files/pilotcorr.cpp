@@ -0,0 +1,357 @@
+#include "pilotcorr.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PILOTCORR_NEON 1
+#endif
+
+// Bit positions of the signed 14-bit channels in a packed ADC word
+#define ADC_CH1_SHIFT 18
+#define ADC_CH2_SHIFT 2
+
+// Full-scale Q15 pilot component
+#define Q15_MAX 32767
+
+// Peak code and noise amplitude of the conformance-check window
+#define CHECK_PILOT_CODE 4095
+#define CHECK_NOISE_CODE 64
+
+// Calibration offset (codes) of the second conformance pass; not a whole code on purpose
+#define CHECK_OFFSET_CODE 37.25f
+
+// Each overlap-save block is at least this many times the pilot length, so the
+// fraction of every FFT that is discarded as wrap-around stays small.
+#define CORR_BLOCK_FACTOR 4
+#define CORR_MIN_FFT_SIZE 256
+
+PilotCorrelator::PilotCorrelator()
+    : m_length(0), m_fftSize(0), m_step(0), m_energy(0.0f) {
+}
+
+void PilotCorrelator::setPilot(const std::vector<std::complex<float>>& pilot) {
+    m_pilot = pilot;
+    m_length = pilot.size();
+    m_energy = 0.0f;
+    for (const auto& sample : pilot) {
+        m_energy += std::norm(sample);
+    }
+
+    if (m_length == 0) {
+        m_fftSize = 0;
+        m_step = 0;
+        m_pilotSpectrum.clear();
+        return;
+    }
+
+    m_fftSize = FFT::nextPowerOfTwo(std::max((size_t)CORR_MIN_FFT_SIZE, m_length * CORR_BLOCK_FACTOR));
+    // Outputs 0..N-L of a circular correlation do not wrap around
+    m_step = m_fftSize - m_length + 1;
+    m_fft.init(m_fftSize);
+
+    // Store conj(P) / N so the inverse transform needs no extra scaling pass
+    m_pilotSpectrum.assign(m_fftSize, std::complex<float>(0.0f, 0.0f));
+    std::copy(pilot.begin(), pilot.end(), m_pilotSpectrum.begin());
+    m_fft.forward(m_pilotSpectrum.data());
+    const float scale = 1.0f / (float)m_fftSize;
+    for (auto& bin : m_pilotSpectrum) {
+        bin = std::conj(bin) * scale;
+    }
+}
+
+void PilotCorrelator::correlate(const std::complex<float>* x, size_t count, std::complex<float>* out) const {
+    if (m_length == 0) {
+        std::fill(out, out + count, std::complex<float>(0.0f, 0.0f));
+        return;
+    }
+
+    const size_t available = count + m_length - 1;
+    std::vector<std::complex<float>> block(m_fftSize);
+
+    for (size_t blockStart = 0; blockStart < count; blockStart += m_step) {
+        // Load one block; the tail past the end of the input is zero-padded
+        size_t blockInput = std::min(m_fftSize, available - blockStart);
+        std::copy(x + blockStart, x + blockStart + blockInput, block.begin());
+        std::fill(block.begin() + blockInput, block.end(), std::complex<float>(0.0f, 0.0f));
+
+        m_fft.forward(block.data());
+        for (size_t k = 0; k < m_fftSize; k++) {
+            const std::complex<float> a = block[k];
+            const std::complex<float> b = m_pilotSpectrum[k];
+            block[k] = std::complex<float>(a.real() * b.real() - a.imag() * b.imag(),
+                                             a.real() * b.imag() + a.imag() * b.real());
+        }
+        m_fft.inverse(block.data());
+
+        size_t blockOutput = std::min(m_step, count - blockStart);
+        std::copy(block.begin(), block.begin() + blockOutput, out + blockStart);
+    }
+}
+
+FixedPilotCorrelator::FixedPilotCorrelator()
+    : m_length(0), m_magnitudeScale(0.0f), m_pilotEnergy(0.0),
+      m_offsetCode(0.0), m_offsetReal(0.0), m_offsetImag(0.0) {
+}
+
+void FixedPilotCorrelator::setPilot(const std::vector<std::complex<float>>& pilot, float voltsPerCode, float offsetVolts) {
+    m_length = pilot.size();
+    m_pilotReal.resize(m_length);
+    m_pilotImag.resize(m_length);
+
+    float peak = 0.0f;
+    for (const auto& sample : pilot) {
+        peak = std::max(peak, std::max(std::fabs(sample.real()), std::fabs(sample.imag())));
+    }
+    const float toQ15 = (peak > 0.0f) ? Q15_MAX / peak : 0.0f;
+
+    m_pilotEnergy = 0.0;
+    int64_t sumReal = 0;
+    int64_t sumImag = 0;
+    for (size_t k = 0; k < m_length; k++) {
+        m_pilotReal[k] = (int16_t)std::lrint(pilot[k].real() * toQ15);
+        m_pilotImag[k] = (int16_t)std::lrint(pilot[k].imag() * toQ15);
+        m_pilotEnergy += (double)m_pilotReal[k] * m_pilotReal[k] + (double)m_pilotImag[k] * m_pilotImag[k];
+        sumReal += m_pilotReal[k];
+        sumImag += m_pilotImag[k];
+    }
+    m_magnitudeScale = (toQ15 > 0.0f) ? voltsPerCode / toQ15 : 0.0f;
+
+    // (x + o(1 + j)) conj(p) adds o * sum (pr + pi) + j o * sum (pr - pi) to the code correlation
+    m_offsetCode = (voltsPerCode != 0.0f) ? (double)offsetVolts / voltsPerCode : 0.0;
+    m_offsetReal = m_offsetCode * (double)(sumReal + sumImag);
+    m_offsetImag = m_offsetCode * (double)(sumReal - sumImag);
+}
+
+void FixedPilotCorrelator::correlate(const uint32_t* words, size_t count, float* score, float* magnitude) const {
+    if (m_length == 0 || count == 0) {
+        std::fill(score, score + count, 0.0f);
+        if (magnitude) {
+            std::fill(magnitude, magnitude + count, 0.0f);
+        }
+        return;
+    }
+
+    // Sign-extend the window once instead of once per pilot tap
+    const size_t available = count + m_length - 1;
+    std::vector<int16_t> real(available);
+    std::vector<int16_t> imag(available);
+    for (size_t n = 0; n < available; n++) {
+        int32_t w = (int32_t)words[n];
+        real[n] = (int16_t)(w >> ADC_CH1_SHIFT);
+        imag[n] = (int16_t)((int32_t)((uint32_t)w << 16) >> (16 + ADC_CH2_SHIFT));
+    }
+    const int16_t* xr = real.data();
+    const int16_t* xi = imag.data();
+    const int16_t* pr = m_pilotReal.data();
+    const int16_t* pi = m_pilotImag.data();
+
+    // Exact integer signal energy and code sum over the first window
+    int64_t energy = 0;
+    int64_t level = 0;
+    for (size_t k = 0; k < m_length; k++) {
+        energy += (int32_t)xr[k] * xr[k] + (int32_t)xi[k] * xi[k];
+        level += (int32_t)xr[k] + xi[k];
+    }
+    // |x + o(1 + j)|^2 summed over the window adds 2o * level + 2 * length * o^2
+    const double offsetEnergy = 2.0 * (double)m_length * m_offsetCode * m_offsetCode;
+
+    for (size_t n = 0; n < count; n++) {
+        if (n > 0) {
+            size_t in = n + m_length - 1;
+            energy += (int32_t)xr[in] * xr[in] + (int32_t)xi[in] * xi[in];
+            energy -= (int32_t)xr[n - 1] * xr[n - 1] + (int32_t)xi[n - 1] * xi[n - 1];
+            level += (int32_t)xr[in] + xi[in] - xr[n - 1] - xi[n - 1];
+        }
+
+        // c = sum x * conj(p) = sum (xr*pr + xi*pi) + j(xi*pr - xr*pi)
+        int64_t corrReal = 0;
+        int64_t corrImag = 0;
+        size_t k = 0;
+#ifdef PILOTCORR_NEON
+        int64x2_t accReal = vdupq_n_s64(0);
+        int64x2_t accImag = vdupq_n_s64(0);
+        // Two 4-tap steps add at most 2^30 per 32-bit lane, so widen every 8 taps
+        for (; k + 8 <= m_length; k += 8) {
+            int16x4_t xr0 = vld1_s16(xr + n + k), xi0 = vld1_s16(xi + n + k);
+            int16x4_t pr0 = vld1_s16(pr + k), pi0 = vld1_s16(pi + k);
+            int16x4_t xr1 = vld1_s16(xr + n + k + 4), xi1 = vld1_s16(xi + n + k + 4);
+            int16x4_t pr1 = vld1_s16(pr + k + 4), pi1 = vld1_s16(pi + k + 4);
+
+            int32x4_t re = vmull_s16(xr0, pr0);
+            re = vmlal_s16(re, xi0, pi0);
+            int32x4_t re1 = vmull_s16(xr1, pr1);
+            re1 = vmlal_s16(re1, xi1, pi1);
+            int32x4_t im = vmull_s16(xi0, pr0);
+            im = vmlsl_s16(im, xr0, pi0);
+            int32x4_t im1 = vmull_s16(xi1, pr1);
+            im1 = vmlsl_s16(im1, xr1, pi1);
+
+            accReal = vpadalq_s32(vpadalq_s32(accReal, re), re1);
+            accImag = vpadalq_s32(vpadalq_s32(accImag, im), im1);
+        }
+        corrReal = vgetq_lane_s64(accReal, 0) + vgetq_lane_s64(accReal, 1);
+        corrImag = vgetq_lane_s64(accImag, 0) + vgetq_lane_s64(accImag, 1);
+#endif
+        for (; k < m_length; k++) {
+            corrReal += (int32_t)xr[n + k] * pr[k] + (int32_t)xi[n + k] * pi[k];
+            corrImag += (int32_t)xi[n + k] * pr[k] - (int32_t)xr[n + k] * pi[k];
+        }
+
+        const double re = (double)corrReal + m_offsetReal;
+        const double im = (double)corrImag + m_offsetImag;
+        const double signalEnergy = (double)energy + 2.0 * m_offsetCode * (double)level + offsetEnergy;
+        double corrMag = std::sqrt(re * re + im * im);
+        float value = 0.0f;
+        if (signalEnergy > 0.0 && m_pilotEnergy > 0.0) {
+            value = (float)std::min(1.0, corrMag / std::sqrt(signalEnergy * m_pilotEnergy));
+        }
+        score[n] = value;
+        if (magnitude) {
+            magnitude[n] = (float)corrMag * m_magnitudeScale;
+        }
+    }
+}
+
+// Boxcar-average blocks of `factor` samples; a partial last block is dropped
+static void decimate(const std::complex<float>* x, size_t count, size_t factor, std::vector<std::complex<float>>& out) {
+    out.resize(count / factor);
+    const float scale = 1.0f / (float)factor;
+    for (size_t m = 0; m < out.size(); m++) {
+        std::complex<float> sum(0.0f, 0.0f);
+        for (size_t k = 0; k < factor; k++) {
+            sum += x[m * factor + k];
+        }
+        out[m] = sum * scale;
+    }
+}
+
+CoarsePilotCorrelator::CoarsePilotCorrelator()
+    : m_length(0), m_decimation(1) {
+}
+
+void CoarsePilotCorrelator::setPilot(const std::vector<std::complex<float>>& pilot, size_t decimation) {
+    m_decimation = std::max((size_t)1, decimation);
+    std::vector<std::complex<float>> decimated;
+    decimate(pilot.data(), pilot.size(), m_decimation, decimated);
+    m_length = decimated.empty() ? 0 : pilot.size();
+    m_correlator.setPilot(decimated);
+}
+
+void CoarsePilotCorrelator::correlate(const std::complex<float>* x, size_t count, float minPower,
+                                      std::vector<float>& score) const {
+    score.clear();
+    if (m_length == 0 || count == 0) {
+        return;
+    }
+
+    // Only whole decimated windows that start inside the range are scored
+    std::vector<std::complex<float>> decimated;
+    decimate(x, count + m_length - 1, m_decimation, decimated);
+    const size_t window = m_correlator.length();
+    if (decimated.size() < window) {
+        return;
+    }
+    const size_t coarseCount = std::min(decimated.size() - window + 1, (count - 1) / m_decimation + 1);
+
+    std::vector<std::complex<float>> corr(coarseCount);
+    std::vector<float> energy(coarseCount);
+    m_correlator.correlate(decimated.data(), coarseCount, corr.data());
+    slidingEnergy(decimated.data(), coarseCount, window, energy.data());
+
+    score.resize(coarseCount);
+    const float minEnergy = minPower * (float)window;
+    for (size_t m = 0; m < coarseCount; m++) {
+        score[m] = (energy[m] < minEnergy) ? 0.0f : normalizedCorrelation(corr[m], energy[m], m_correlator.energy());
+    }
+}
+
+void slidingEnergy(const std::complex<float>* x, size_t count, size_t window, float* out) {
+    if (count == 0) {
+        return;
+    }
+
+    double energy = 0.0;
+    for (size_t i = 0; i < window; i++) {
+        energy += std::norm(x[i]);
+    }
+    out[0] = (float)energy;
+
+    for (size_t n = 1; n < count; n++) {
+        energy += (double)std::norm(x[n + window - 1]) - (double)std::norm(x[n - 1]);
+        out[n] = (float)std::max(0.0, energy);
+    }
+}
+
+float normalizedCorrelation(std::complex<float> corr, float signalEnergy, float pilotEnergy) {
+    if (signalEnergy <= 0.0f || pilotEnergy <= 0.0f) {
+        return 0.0f;
+    }
+    float value = std::abs(corr) / std::sqrt(signalEnergy * pilotEnergy);
+    return std::min(value, 1.0f);
+}
+
+/*
+ * One conformance pass: noise, pilot, noise as ADC words, scored by both paths.
+ * The float samples are the codes plus the offset of `fixed`, i.e. the calibrated
+ * volts divided by the scale, since both scores are scale invariant.
+ */
+static float fixedCorrelationPass(const PilotCorrelator& reference, const FixedPilotCorrelator& fixed, float peak) {
+    const std::vector<std::complex<float>>& pilot = reference.pilot();
+    const size_t length = pilot.size();
+    const float offset = (float)fixed.offsetCode();
+    const size_t total = 3 * length;
+    const size_t count = total - length + 1;
+    std::vector<uint32_t> words(total);
+    std::vector<std::complex<float>> samples(total);
+    uint32_t noise = 1;
+    for (size_t n = 0; n < total; n++) {
+        int32_t codeI, codeQ;
+        if (n >= length && n < 2 * length) {
+            codeI = (int32_t)std::lrint(pilot[n - length].real() / peak * CHECK_PILOT_CODE);
+            codeQ = (int32_t)std::lrint(pilot[n - length].imag() / peak * CHECK_PILOT_CODE);
+        } else {
+            noise = noise * 1664525u + 1013904223u;
+            codeI = (int32_t)((noise >> 16) % (2 * CHECK_NOISE_CODE + 1)) - CHECK_NOISE_CODE;
+            codeQ = (int32_t)((noise >> 4) % (2 * CHECK_NOISE_CODE + 1)) - CHECK_NOISE_CODE;
+        }
+        words[n] = ((uint32_t)codeI << ADC_CH1_SHIFT) | (((uint32_t)codeQ << ADC_CH2_SHIFT) & 0xFFFCu);
+        samples[n] = std::complex<float>((float)codeI + offset, (float)codeQ + offset);
+    }
+
+    std::vector<std::complex<float>> corr(count);
+    std::vector<float> energy(count);
+    std::vector<float> fixedScore(count);
+    reference.correlate(samples.data(), count, corr.data());
+    slidingEnergy(samples.data(), count, length, energy.data());
+    fixed.correlate(words.data(), count, fixedScore.data(), NULL);
+
+    float worst = 0.0f;
+    for (size_t n = 0; n < count; n++) {
+        float expected = normalizedCorrelation(corr[n], energy[n], reference.energy());
+        worst = std::max(worst, std::fabs(expected - fixedScore[n]));
+    }
+    return worst;
+}
+
+float fixedCorrelationError(const PilotCorrelator& reference, const FixedPilotCorrelator& fixed) {
+    const std::vector<std::complex<float>>& pilot = reference.pilot();
+    const size_t length = pilot.size();
+    if (length == 0 || fixed.length() != length) {
+        return 1.0f;
+    }
+
+    float peak = 0.0f;
+    for (const auto& sample : pilot) {
+        peak = std::max(peak, std::max(std::fabs(sample.real()), std::fabs(sample.imag())));
+    }
+    if (peak <= 0.0f) {
+        return 1.0f;
+    }
+
+    // The same pilot quantisation with a non-zero offset, whatever the calibration of `fixed`
+    FixedPilotCorrelator shifted;
+    shifted.setPilot(pilot, 1.0f, CHECK_OFFSET_CODE);
+    return std::max(fixedCorrelationPass(reference, fixed, peak), fixedCorrelationPass(reference, shifted, peak));
+}
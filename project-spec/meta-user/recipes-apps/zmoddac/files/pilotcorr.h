@@ -0,0 +1,162 @@
+#ifndef PILOTCORR_H
+#define PILOTCORR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <complex>
+#include <vector>
+
+#include "fft.h"
+
+/*
+ * Frequency-domain pilot correlator using overlap-save blocks.
+ *
+ * The pilot spectrum is computed once in setPilot(). correlate() then produces
+ *   c[n] = sum_k x[n + k] * conj(p[k])
+ * for every requested position, which is the same quantity the brute-force
+ * time-domain loop computes, at O(log N) cost per output instead of O(L).
+ * correlate() keeps no state between calls, so one correlator can serve
+ * several threads at once.
+ */
+class PilotCorrelator {
+public:
+    PilotCorrelator();
+
+    // Cache the pilot and its conjugate spectrum
+    void setPilot(const std::vector<std::complex<float>>& pilot);
+
+    bool empty() const { return m_length == 0; }
+    size_t length() const { return m_length; }
+    float energy() const { return m_energy; }
+    const std::vector<std::complex<float>>& pilot() const { return m_pilot; }
+
+    /*
+     * Correlate the pilot against x at positions [0, count).
+     * @param x - Input samples, must hold count + length() - 1 samples
+     * @param count - Number of positions to evaluate
+     * @param out - Receives count complex correlation values
+     */
+    void correlate(const std::complex<float>* x, size_t count, std::complex<float>* out) const;
+
+private:
+    size_t m_length;
+    size_t m_fftSize;
+    size_t m_step;
+    float m_energy;
+    FFT m_fft;
+    std::vector<std::complex<float>> m_pilot;
+    std::vector<std::complex<float>> m_pilotSpectrum;
+};
+
+/*
+ * Fixed-point pilot correlator working directly on packed ADC DMA words.
+ *
+ * The pilot is quantised once to Q15 (scaled so its largest component uses
+ * the full int16 range). Each position is a time-domain 16x16->32-bit
+ * multiply-accumulate of the sign-extended 14-bit I/Q fields against the Q15
+ * pilot, widened to 64 bits before it can overflow; on ARM this is NEON
+ * VMLAL. Signal energy is an exact integer sliding sum. The calibration
+ * offset, offset()/scale() in codes, is applied to the integer sums in the
+ * final floating-point step, so the codes correlated are proportional to the
+ * calibrated volts. Because the score is scale invariant it then matches the
+ * float path up to the pilot quantisation.
+ * Like PilotCorrelator, correlate() may be called from several threads.
+ */
+class FixedPilotCorrelator {
+public:
+    FixedPilotCorrelator();
+
+    /*
+     * Quantise and cache the pilot.
+     * @param pilot - Pilot in volts
+     * @param voltsPerCode - ADC volts per raw code, used to report |c| in volts
+     * @param offsetVolts - ADC volts at code 0 on both channels, as AdcIqConverter::offset()
+     */
+    void setPilot(const std::vector<std::complex<float>>& pilot, float voltsPerCode, float offsetVolts);
+
+    bool empty() const { return m_length == 0; }
+    size_t length() const { return m_length; }
+    double offsetCode() const { return m_offsetCode; }
+
+    /*
+     * Score positions [0, count) of the packed word stream.
+     * @param words - Packed ADC words, must hold count + length() - 1 words
+     * @param count - Number of positions to evaluate
+     * @param score - Receives the normalised correlation per position
+     * @param magnitude - Receives |c| in volts per position (may be NULL)
+     */
+    void correlate(const uint32_t* words, size_t count, float* score, float* magnitude) const;
+
+private:
+    size_t m_length;
+    float m_magnitudeScale;
+    double m_pilotEnergy;
+    double m_offsetCode;        // Calibration offset in codes, added to every I and Q code
+    double m_offsetReal;        // Its contribution to the correlation: o * sum (pr + pi)
+    double m_offsetImag;        // o * sum (pr - pi)
+    std::vector<int16_t> m_pilotReal;
+    std::vector<int16_t> m_pilotImag;
+};
+
+/*
+ * Coarse stage of the two-stage pilot detector.
+ *
+ * The pilot and the signal are both boxcar-averaged over `decimation`
+ * samples and decimated by the same factor. The band-limited pilot loses
+ * little of its correlation peak, while every coarse position costs about
+ * 1/decimation of a full-rate one. Windows whose mean power is below an
+ * energy gate are rejected before their score is computed. Positions with
+ * a high coarse score are then refined at full rate by the caller.
+ */
+class CoarsePilotCorrelator {
+public:
+    CoarsePilotCorrelator();
+
+    /*
+     * Decimate and cache the pilot.
+     * @param pilot - Full-rate pilot
+     * @param decimation - Decimation factor, at least 1
+     */
+    void setPilot(const std::vector<std::complex<float>>& pilot, size_t decimation);
+
+    bool empty() const { return m_length == 0; }
+    size_t length() const { return m_length; }
+    size_t decimation() const { return m_decimation; }
+
+    /*
+     * Score the decimated grid of full-rate positions [0, count).
+     * @param x - Full-rate samples, must hold count + length() - 1 samples
+     * @param count - Number of full-rate positions
+     * @param minPower - Windows with a lower mean power per decimated sample score zero
+     * @param score - Resized to the coarse position count; score[m] belongs to position m * decimation()
+     */
+    void correlate(const std::complex<float>* x, size_t count, float minPower, std::vector<float>& score) const;
+
+private:
+    size_t m_length;
+    size_t m_decimation;
+    PilotCorrelator m_correlator;
+};
+
+/*
+ * Sliding-window energy sum_k |x[n + k]|^2 over a window of the given length,
+ * for positions [0, count). Updated in O(1) per position with a double
+ * accumulator so that long batches do not drift.
+ * x must hold count + window - 1 samples.
+ */
+void slidingEnergy(const std::complex<float>* x, size_t count, size_t window, float* out);
+
+// Normalised correlation |c| / sqrt(signalEnergy * pilotEnergy), clamped to [0, 1]
+float normalizedCorrelation(std::complex<float> corr, float signalEnergy, float pilotEnergy);
+
+/*
+ * Conformance check of the fixed-point path against the float reference.
+ * The reference pilot is quantised to half-scale 14-bit ADC words, embedded
+ * between two pilot lengths of low-level deterministic noise, and both
+ * correlators score every position of the window. The window is scored once
+ * with the offset of `fixed` and once more with a fixed non-zero offset.
+ * @return Largest absolute difference between the two normalised scores
+ */
+float fixedCorrelationError(const PilotCorrelator& reference, const FixedPilotCorrelator& fixed);
+
+#endif // PILOTCORR_H
@@ -0,0 +1,128 @@
+#include "pilotsearch.h"
+
+#include <algorithm>
+#include <complex>
+#include <utility>
+#include <vector>
+
+#include "iqconvert.h"
+#include "threadpool.h"
+
+// Correlation positions per thread-pool task; fixed so results do not depend on the core count
+#define SEARCH_CHUNK_LENGTH 65536
+
+// Coarse candidates are refined within this many coarse steps
+#define COARSE_REFINE_RADIUS 2
+
+/*
+ * Score of one pilot at positions [0, count). The Q15 detector reads the words
+ * directly; the float detector converts only the count + pilot length - 1 words
+ * it needs.
+ */
+static void scorePilot(const PilotSearchContext& context, const PilotDetector& detector, bool useFixed,
+                       const uint32_t* words, size_t count, float* score, float* magnitude) {
+    if (count == 0) {
+        return;
+    }
+    if (useFixed) {
+        detector.fixedCorrelator.correlate(words, count, score, magnitude);
+        return;
+    }
+
+    const PilotCorrelator& correlator = detector.correlator;
+    std::vector<std::complex<float>> samples(count + correlator.length() - 1);
+    context.converter->convertComplex(words, samples.size(), samples.data());
+    std::vector<std::complex<float>> corr(count);
+    std::vector<float> signalEnergy(count);
+    correlator.correlate(samples.data(), count, corr.data());
+    slidingEnergy(samples.data(), count, correlator.length(), signalEnergy.data());
+    for (size_t k = 0; k < count; k++) {
+        score[k] = normalizedCorrelation(corr[k], signalEnergy[k], correlator.energy());
+        magnitude[k] = std::abs(corr[k]);
+    }
+}
+
+/*
+ * Score positions [0, count) in SEARCH_CHUNK_LENGTH chunks on the thread pool.
+ * Each chunk also reads the pilot length - 1 samples after its last position, so the
+ * chunks overlap in input. The chunk grid depends only on the range, which makes the
+ * scores, and therefore the earliest detections, the same for any number of threads.
+ */
+static void scorePilotParallel(const PilotSearchContext& context, const PilotDetector& detector, bool useFixed,
+                               const uint32_t* words, size_t count, float* score, float* magnitude) {
+    size_t chunks = (count + SEARCH_CHUNK_LENGTH - 1) / SEARCH_CHUNK_LENGTH;
+    context.pool->run(chunks, [&](size_t chunk) {
+        size_t first = chunk * SEARCH_CHUNK_LENGTH;
+        size_t length = std::min((size_t)SEARCH_CHUNK_LENGTH, count - first);
+        scorePilot(context, detector, useFixed, words + first, length, score + first, magnitude + first);
+    });
+}
+
+/*
+ * Coarse-to-fine search of positions [0, count). The coarse correlator scores
+ * the energy-gated decimated grid; positions within COARSE_REFINE_RADIUS coarse steps
+ * of a candidate, and the short tail the grid cannot reach, get full-rate scores on the
+ * thread pool. All other positions score zero.
+ * @return Number of positions scored at full rate
+ */
+static size_t scorePilotCoarse(const PilotSearchContext& context, const PilotDetector& detector, bool useFixed,
+                               const uint32_t* words, size_t count, float* score, float* magnitude) {
+    std::fill(score, score + count, 0.0f);
+    std::fill(magnitude, magnitude + count, 0.0f);
+    if (count == 0) {
+        return 0;
+    }
+
+    // The coarse stage reads the whole range, so it is converted once
+    const CoarsePilotCorrelator& coarse = detector.coarseCorrelator;
+    std::vector<std::complex<float>> samples(count + coarse.length() - 1);
+    context.converter->convertComplex(words, samples.size(), samples.data());
+    std::vector<float> coarseScore;
+    coarse.correlate(samples.data(), count, context.energyGate, coarseScore);
+
+    // Merge the candidate neighbourhoods into disjoint full-rate windows [first, last)
+    const size_t step = coarse.decimation();
+    const size_t radius = COARSE_REFINE_RADIUS * step;
+    std::vector<std::pair<size_t, size_t>> windows;
+    auto addWindow = [&windows](size_t first, size_t last) {
+        if (!windows.empty() && first <= windows.back().second) {
+            windows.back().second = std::max(windows.back().second, last);
+        } else {
+            windows.push_back(std::make_pair(first, last));
+        }
+    };
+    for (size_t m = 0; m < coarseScore.size(); m++) {
+        if (coarseScore[m] >= context.coarseThreshold) {
+            size_t centre = m * step;
+            addWindow(centre > radius ? centre - radius : 0, std::min(count, centre + radius + 1));
+        }
+    }
+    size_t tail = coarseScore.size() * step;
+    if (tail < count) {
+        addWindow(tail, count);
+    }
+
+    // Cut the windows into chunk-sized tasks and refine them in one pool run
+    std::vector<std::pair<size_t, size_t>> tasks;
+    size_t refined = 0;
+    for (const auto& window : windows) {
+        for (size_t first = window.first; first < window.second; first += SEARCH_CHUNK_LENGTH) {
+            tasks.push_back(std::make_pair(first, std::min((size_t)SEARCH_CHUNK_LENGTH, window.second - first)));
+        }
+        refined += window.second - window.first;
+    }
+    context.pool->run(tasks.size(), [&](size_t task) {
+        size_t first = tasks[task].first;
+        scorePilot(context, detector, useFixed, words + first, tasks[task].second, score + first, magnitude + first);
+    });
+    return refined;
+}
+
+size_t searchPilot(const PilotSearchContext& context, const PilotDetector& detector, bool useFixed,
+                   SearchMode mode, const uint32_t* words, size_t count, float* score, float* magnitude) {
+    if (mode == SEARCH_COARSE && !detector.coarseCorrelator.empty()) {
+        return scorePilotCoarse(context, detector, useFixed, words, count, score, magnitude);
+    }
+    scorePilotParallel(context, detector, useFixed, words, count, score, magnitude);
+    return count;
+}
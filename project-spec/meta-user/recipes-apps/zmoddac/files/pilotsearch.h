@@ -0,0 +1,44 @@
+#ifndef PILOTSEARCH_H
+#define PILOTSEARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pilotcorr.h"
+
+class AdcIqConverter;
+class ThreadPool;
+
+// Correlators cached for one pilot
+struct PilotDetector {
+    PilotCorrelator correlator;             // FFT overlap-save on float samples
+    FixedPilotCorrelator fixedCorrelator;   // Q15 on raw ADC words
+    CoarsePilotCorrelator coarseCorrelator; // Decimated first stage of the coarse search
+};
+
+// How the detector visits the search range
+enum SearchMode {
+    SEARCH_EXHAUSTIVE,  // Full-rate score at every position
+    SEARCH_COARSE       // Energy-gated decimated pass, full-rate refinement around candidates
+};
+
+// What a pilot search runs on
+struct PilotSearchContext {
+    const AdcIqConverter* converter;    // Raw words to volts for the float and coarse correlators
+    ThreadPool* pool;                   // Scores positions in fixed-size chunks
+    float coarseThreshold;              // Coarse score that makes a position a candidate
+    float energyGate;                   // Minimum mean power (V^2) of a decimated window, 0 disables
+};
+
+/*
+ * Normalised score and |c| of one pilot at positions [0, count) of the raw
+ * capture words, exhaustive or coarse-to-fine. The scores do not depend on the
+ * number of pool threads. Positions the coarse search does not refine score zero.
+ * @param useFixed - Q15 correlator on the raw words instead of the float one
+ * @param words - Packed ADC words, must hold count + pilot length - 1 words
+ * @return Number of positions scored at full rate
+ */
+size_t searchPilot(const PilotSearchContext& context, const PilotDetector& detector, bool useFixed,
+                   SearchMode mode, const uint32_t* words, size_t count, float* score, float* magnitude);
+
+#endif // PILOTSEARCH_H
@@ -0,0 +1,311 @@
+#include "protocol.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// Pacing of legacy binary replies: after the header line and between binary parts
+#define LEGACY_HEADER_GAP_US 500000
+#define LEGACY_SEGMENT_GAP_US 100000
+
+// First wire byte of PROTOCOL_MAGIC
+#define PROTOCOL_MAGIC_FIRST_BYTE 0xA5
+
+// Drop the first transferred bytes from an I/O vector, and any empty entries in front
+static void advance(struct iovec*& iov, size_t& count, size_t transferred) {
+    while (count > 0 && transferred >= iov->iov_len) {
+        transferred -= iov->iov_len;
+        iov++;
+        count--;
+    }
+    if (count > 0) {
+        iov->iov_base = (char*)iov->iov_base + transferred;
+        iov->iov_len -= transferred;
+    }
+}
+
+// Gathered send of all entries, continuing after short writes; the entries are consumed
+static bool sendVector(int fd, struct iovec* iov, size_t count) {
+    advance(iov, count, 0);
+    while (count > 0) {
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = iov;
+        message.msg_iovlen = std::min(count, (size_t)IOV_MAX);
+        ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        advance(iov, count, sent);
+    }
+    return true;
+}
+
+// Scattered receive filling all entries, continuing after short reads; the entries are consumed
+static bool receiveVector(int fd, struct iovec* iov, size_t count) {
+    advance(iov, count, 0);
+    while (count > 0) {
+        ssize_t received = readv(fd, iov, (int)std::min(count, (size_t)IOV_MAX));
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        advance(iov, count, received);
+    }
+    return true;
+}
+
+static bool sendAll(int fd, const void* data, size_t length) {
+    struct iovec iov = { const_cast<void*>(data), length };
+    return sendVector(fd, &iov, 1);
+}
+
+static bool receiveAll(int fd, void* data, size_t length) {
+    struct iovec iov = { data, length };
+    return receiveVector(fd, &iov, 1);
+}
+
+// Read and drop length bytes
+static bool discard(int fd, size_t length) {
+    char scratch[4096];
+    while (length > 0) {
+        size_t chunk = std::min(length, sizeof(scratch));
+        if (!receiveAll(fd, scratch, chunk)) {
+            return false;
+        }
+        length -= chunk;
+    }
+    return true;
+}
+
+ClientSession::ClientSession(int fd)
+    : m_fd(fd), m_detected(false), m_framed(false), m_requestId(0), m_dataRemaining(0),
+      m_sampleFormat(SAMPLE_FORMAT_FLOAT32_PLANAR) {
+}
+
+bool ClientSession::detect() {
+    unsigned char first;
+    ssize_t peeked;
+    do {
+        peeked = recv(m_fd, &first, 1, MSG_PEEK);
+    } while (peeked < 0 && errno == EINTR);
+    if (peeked <= 0) {
+        return false;
+    }
+    m_framed = first == PROTOCOL_MAGIC_FIRST_BYTE;
+    m_detected = true;
+    std::cout << "Client protocol: " << (m_framed ? "framed" : "legacy text") << std::endl;
+    return true;
+}
+
+bool ClientSession::readHeader(MessageHeader& header) {
+    if (!receiveAll(m_fd, &header, sizeof(header))) {
+        return false;
+    }
+    if (header.magic != PROTOCOL_MAGIC || header.version != PROTOCOL_VERSION) {
+        std::cerr << "Protocol error: bad magic 0x" << std::hex << header.magic << std::dec
+                  << " or version " << header.version << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ClientSession::readCommand(char* buffer, size_t size) {
+    if (!m_detected && !detect()) {
+        return false;
+    }
+
+    if (!m_framed) {
+        memset(buffer, 0, size);
+        ssize_t received;
+        do {
+            received = recv(m_fd, buffer, size - 1, 0);
+        } while (received < 0 && errno == EINTR);
+        return received > 0;
+    }
+
+    // Upload data the last command did not consume
+    if (m_dataRemaining > 0 && !discard(m_fd, m_dataRemaining)) {
+        return false;
+    }
+    m_dataRemaining = 0;
+
+    while (true) {
+        MessageHeader header;
+        if (!readHeader(header)) {
+            return false;
+        }
+        if (header.type == MESSAGE_DATA) {
+            std::cerr << "Dropping " << header.payloadLength << " bytes of unexpected upload data" << std::endl;
+            if (!discard(m_fd, header.payloadLength)) {
+                return false;
+            }
+            continue;
+        }
+        if (header.type != MESSAGE_COMMAND || header.payloadLength >= size ||
+            header.payloadLength > PROTOCOL_MAX_COMMAND) {
+            std::cerr << "Protocol error: message type " << header.type << " with "
+                      << header.payloadLength << " bytes where a command was expected" << std::endl;
+            return false;
+        }
+        if (!receiveAll(m_fd, buffer, header.payloadLength)) {
+            return false;
+        }
+        buffer[header.payloadLength] = '\0';
+        m_requestId = header.requestId;
+        return true;
+    }
+}
+
+bool ClientSession::receive(void* buffer, size_t length) {
+    ReceiveSegment segment = { buffer, length };
+    return receive(&segment, 1);
+}
+
+bool ClientSession::receive(const ReceiveSegment* segments, size_t count) {
+    std::vector<struct iovec> vector(count);
+    for (size_t i = 0; i < count; i++) {
+        vector[i].iov_base = segments[i].data;
+        vector[i].iov_len = segments[i].length;
+    }
+    struct iovec* iov = vector.data();
+    if (!m_framed) {
+        return receiveVector(m_fd, iov, count);
+    }
+
+    // Each DATA message fills as much of the remaining buffers as it holds
+    std::vector<struct iovec> window;
+    advance(iov, count, 0);
+    while (count > 0) {
+        if (m_dataRemaining == 0) {
+            MessageHeader header;
+            if (!readHeader(header)) {
+                return false;
+            }
+            if (header.type != MESSAGE_DATA || header.requestId != m_requestId ||
+                header.payloadLength > PROTOCOL_MAX_DATA) {
+                std::cerr << "Protocol error: expected upload data for request " << m_requestId << std::endl;
+                return false;
+            }
+            m_dataRemaining = header.payloadLength;
+            continue;
+        }
+        window.clear();
+        size_t windowLength = 0;
+        for (size_t i = 0; i < count && windowLength < m_dataRemaining; i++) {
+            struct iovec part = iov[i];
+            part.iov_len = std::min(part.iov_len, m_dataRemaining - windowLength);
+            windowLength += part.iov_len;
+            window.push_back(part);
+        }
+        if (!receiveVector(m_fd, window.data(), window.size())) {
+            return false;
+        }
+        advance(iov, count, windowLength);
+        m_dataRemaining -= windowLength;
+    }
+    return true;
+}
+
+bool ClientSession::frame(MessageHeader& header, MessageType type, SampleFormat format,
+                          const DataSegment* segments, size_t count) {
+    size_t payloadLength = 0;
+    for (size_t i = 0; i < count; i++) {
+        payloadLength += segments[i].length;
+    }
+    if (payloadLength > UINT32_MAX) {
+        std::cerr << "Reply of " << payloadLength << " bytes does not fit one message" << std::endl;
+        return false;
+    }
+
+    header.magic = PROTOCOL_MAGIC;
+    header.version = PROTOCOL_VERSION;
+    header.type = (uint16_t)type;
+    header.requestId = m_requestId;
+    header.payloadLength = (uint32_t)payloadLength;
+    header.sampleFormat = (uint16_t)format;
+    header.reserved = 0;
+    return true;
+}
+
+// Append the header and segments of one message to an I/O vector
+static void gather(std::vector<struct iovec>& iov, MessageHeader& header, const DataSegment* segments, size_t count) {
+    iov.push_back({ &header, sizeof(header) });
+    for (size_t i = 0; i < count; i++) {
+        iov.push_back({ const_cast<void*>(segments[i].data), segments[i].length });
+    }
+}
+
+bool ClientSession::sendMessage(MessageType type, SampleFormat format, const DataSegment* segments, size_t count) {
+    MessageHeader header;
+    if (!frame(header, type, format, segments, count)) {
+        return false;
+    }
+    std::vector<struct iovec> iov;
+    gather(iov, header, segments, count);
+    return sendVector(m_fd, iov.data(), iov.size());
+}
+
+bool ClientSession::sendText(const char* text) {
+    if (!m_framed) {
+        return sendAll(m_fd, text, strlen(text));
+    }
+    DataSegment segment = { text, strlen(text) };
+    return sendMessage(MESSAGE_TEXT, SAMPLE_FORMAT_NONE, &segment, 1);
+}
+
+bool ClientSession::sendError(const char* text) {
+    if (!m_framed) {
+        return sendAll(m_fd, text, strlen(text));
+    }
+    DataSegment segment = { text, strlen(text) };
+    return sendMessage(MESSAGE_ERROR, SAMPLE_FORMAT_NONE, &segment, 1);
+}
+
+bool ClientSession::sendData(const char* header, const DataSegment* segments, size_t count, SampleFormat format) {
+    if (m_framed) {
+        // Both messages leave in one gathered write, straight from the reply buffers
+        DataSegment text = { header, strlen(header) };
+        MessageHeader textHeader;
+        MessageHeader dataHeader;
+        if (!frame(textHeader, MESSAGE_TEXT, SAMPLE_FORMAT_NONE, &text, 1) ||
+            !frame(dataHeader, MESSAGE_DATA, format, segments, count)) {
+            return false;
+        }
+        std::vector<struct iovec> iov;
+        gather(iov, textHeader, &text, 1);
+        gather(iov, dataHeader, segments, count);
+        return sendVector(m_fd, iov.data(), iov.size());
+    }
+
+    // Legacy clients read each part with a separate read and rely on the gaps
+    if (!sendAll(m_fd, header, strlen(header))) {
+        return false;
+    }
+    usleep(LEGACY_HEADER_GAP_US);
+    bool first = true;
+    for (size_t i = 0; i < count; i++) {
+        if (segments[i].length == 0) {
+            continue;
+        }
+        if (!first) {
+            usleep(LEGACY_SEGMENT_GAP_US);
+        }
+        first = false;
+        if (!sendAll(m_fd, segments[i].data, segments[i].length)) {
+            return false;
+        }
+    }
+    return true;
+}
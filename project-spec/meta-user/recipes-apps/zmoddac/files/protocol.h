@@ -0,0 +1,142 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Framed client protocol of zmodstart.
+ *
+ * Every command and reply is one message: a fixed MessageHeader followed by
+ * payloadLength bytes. All fields are little-endian, the native order of both
+ * the Zynq and the MATLAB host. The first byte of the magic is not printable,
+ * so the first byte a client sends tells a framed client from a legacy one.
+ *
+ * A command's payload is its text, e.g. "receive filter=rrc". Uploads
+ * (transmit, filtered_pilots, reference) follow in DATA messages carrying the
+ * same bytes as the legacy upload; they may be split over several messages
+ * and may be sent without waiting for the "Ready" reply. A reply with samples
+ * is a TEXT message with the legacy header line ("SAMPLES=n", ...) followed by
+ * one DATA message holding all of the binary parts. Replies echo the request
+ * id of their command.
+ */
+
+// Wire bytes A5 5A 49 51
+#define PROTOCOL_MAGIC 0x51495AA5u
+#define PROTOCOL_VERSION 1
+
+// Largest command text and largest single upload message
+#define PROTOCOL_MAX_COMMAND 8192
+#define PROTOCOL_MAX_DATA (256u * 1024 * 1024)
+
+enum MessageType {
+    MESSAGE_COMMAND = 1,    // Client: command line
+    MESSAGE_DATA = 2,       // Client upload, or binary part of a reply
+    MESSAGE_TEXT = 3,       // Server: acknowledgement, report or reply header
+    MESSAGE_ERROR = 4       // Server: the command failed; text payload
+};
+
+/*
+ * Layout of the samples of uploads and replies, chosen per session with the
+ * "format" command. Legacy planar is the default; transmit uploads in it keep
+ * their old order of all imaginary parts first.
+ */
+enum SampleFormat {
+    SAMPLE_FORMAT_NONE = 0,                 // Text or non-sample binary
+    SAMPLE_FORMAT_FLOAT32_PLANAR = 1,       // All real parts, then all imaginary parts
+    SAMPLE_FORMAT_FLOAT32_INTERLEAVED = 2,  // I, Q float32 pairs
+    SAMPLE_FORMAT_INT16_INTERLEAVED = 3,    // I, Q int16 code pairs; replies start with a SampleCalibration
+    SAMPLE_FORMAT_PACKED14 = 4,             // 28-bit I, Q code pairs (packed14.h); replies start with a SampleCalibration
+    SAMPLE_FORMAT_RICE14 = 5                // Lossless coded 14-bit codes (iqcodec.h); replies start with a SampleCalibration
+};
+
+// Leads the samples of an int16, packed14 or rice reply: volts = code * scale + offset
+struct SampleCalibration {
+    float scale;
+    float offset;
+};
+
+struct MessageHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type;              // MessageType
+    uint32_t requestId;         // Chosen by the client, echoed in every reply message
+    uint32_t payloadLength;     // Bytes following the header
+    uint16_t sampleFormat;      // SampleFormat of a DATA payload
+    uint16_t reserved;
+};
+
+static_assert(sizeof(MessageHeader) == 20, "MessageHeader must have no padding");
+
+// One contiguous part of a binary reply
+struct DataSegment {
+    const void* data;
+    size_t length;
+};
+
+// One destination buffer of an upload
+struct ReceiveSegment {
+    void* data;
+    size_t length;
+};
+
+/*
+ * One client connection, in either the framed or the legacy text protocol.
+ *
+ * The protocol is detected from the first byte of the connection. Legacy
+ * clients keep the old behaviour: a command is whatever one recv() returns,
+ * and binary replies are paced with sleeps so the client can tell the parts
+ * apart. Framed clients get no sleeps.
+ */
+class ClientSession {
+public:
+    explicit ClientSession(int fd);
+
+    int fd() const { return m_fd; }
+    bool framed() const { return m_framed; }
+
+    // Sample layout negotiated for this session
+    SampleFormat sampleFormat() const { return m_sampleFormat; }
+    void setSampleFormat(SampleFormat format) { m_sampleFormat = format; }
+
+    /*
+     * Read the next command into a NUL-terminated buffer.
+     * @return false when the client disconnected or broke the framing
+     */
+    bool readCommand(char* buffer, size_t size);
+
+    // Read exactly length bytes of upload data for the current command
+    bool receive(void* buffer, size_t length);
+
+    // Read upload data straight into several buffers, filling them in order
+    bool receive(const ReceiveSegment* segments, size_t count);
+
+    bool sendText(const char* text);
+    bool sendError(const char* text);
+
+    /*
+     * Reply with a header line and binary parts: one TEXT and one DATA message
+     * in a single gathered write when framed, the paced legacy sequence otherwise.
+     * @param header - Header line, e.g. "SAMPLES=1024"
+     * @param segments - Binary parts in wire order
+     * @param count - Number of parts
+     * @param format - SampleFormat of the binary parts
+     */
+    bool sendData(const char* header, const DataSegment* segments, size_t count, SampleFormat format);
+
+private:
+    bool detect();
+    bool frame(MessageHeader& header, MessageType type, SampleFormat format,
+               const DataSegment* segments, size_t count);
+    bool sendMessage(MessageType type, SampleFormat format, const DataSegment* segments, size_t count);
+    bool readHeader(MessageHeader& header);
+
+    int m_fd;
+    bool m_detected;
+    bool m_framed;
+    uint32_t m_requestId;       // Of the command being handled
+    size_t m_dataRemaining;     // Unread bytes of the current upload message
+    SampleFormat m_sampleFormat;
+};
+
+#endif // PROTOCOL_H
@@ -0,0 +1,80 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+/*
+ * Bounded lock-free single-producer/single-consumer ring.
+ *
+ * push() may only be called from one thread and pop() from one other thread.
+ * The ring also keeps the occupancy high-water mark and an overrun counter
+ * that the producer bumps whenever it finds the ring full, so callers can see
+ * when the consumer is falling behind.
+ */
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity)
+        : m_slots(capacity + 1), m_head(0), m_tail(0), m_highWater(0), m_overruns(0) {
+    }
+
+    size_t capacity() const { return m_slots.size() - 1; }
+
+    // Producer side: returns false if the ring is full
+    bool push(const T& item) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t next = increment(tail);
+        if (next == m_head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        m_slots[tail] = item;
+        m_tail.store(next, std::memory_order_release);
+
+        size_t occupancy = size();
+        if (occupancy > m_highWater.load(std::memory_order_relaxed)) {
+            m_highWater.store(occupancy, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // Consumer side: returns false if the ring is empty
+    bool pop(T& item) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = m_slots[head];
+        m_head.store(increment(head), std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        size_t head = m_head.load(std::memory_order_acquire);
+        size_t tail = m_tail.load(std::memory_order_acquire);
+        return (tail >= head) ? (tail - head) : (tail + m_slots.size() - head);
+    }
+
+    bool empty() const { return size() == 0; }
+    bool full() const { return size() == capacity(); }
+
+    // Producer found the ring full and had to wait for the consumer
+    void noteOverrun() { m_overruns.fetch_add(1, std::memory_order_relaxed); }
+
+    size_t highWater() const { return m_highWater.load(std::memory_order_relaxed); }
+    size_t overruns() const { return m_overruns.load(std::memory_order_relaxed); }
+
+private:
+    size_t increment(size_t index) const {
+        return (index + 1 == m_slots.size()) ? 0 : index + 1;
+    }
+
+    std::vector<T> m_slots;
+    std::atomic<size_t> m_head;
+    std::atomic<size_t> m_tail;
+    std::atomic<size_t> m_highWater;
+    std::atomic<size_t> m_overruns;
+};
+
+#endif // SPSCRING_H
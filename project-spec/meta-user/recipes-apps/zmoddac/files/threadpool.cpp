@@ -0,0 +1,62 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(size_t numThreads)
+    : m_task(NULL), m_count(0), m_next(0), m_pending(0), m_stop(false) {
+    for (size_t i = 1; i < numThreads; i++) {
+        m_workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> job(m_runMutex);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_task = &task;
+    m_count = count;
+    m_next = 0;
+    m_pending = count;
+    m_wake.notify_all();
+
+    // The caller works on the job too, then waits for tasks still running elsewhere
+    drain(lock);
+    m_done.wait(lock, [this] { return m_pending == 0; });
+    m_task = NULL;
+}
+
+void ThreadPool::drain(std::unique_lock<std::mutex>& lock) {
+    while (m_task && m_next < m_count) {
+        const std::function<void(size_t)>* task = m_task;
+        size_t index = m_next++;
+        lock.unlock();
+        (*task)(index);
+        lock.lock();
+        if (--m_pending == 0) {
+            m_done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::workerLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_wake.wait(lock, [this] { return m_stop || (m_task && m_next < m_count); });
+        if (m_stop) {
+            return;
+        }
+        drain(lock);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed pool of worker threads for data-parallel DSP loops.
+ *
+ * Created once at startup; run() hands out task indices to the workers and to
+ * the calling thread and returns when every task has finished. Jobs from
+ * different callers are serialised, one job runs at a time.
+ */
+class ThreadPool {
+public:
+    // numThreads includes the calling thread, so numThreads - 1 workers are started
+    explicit ThreadPool(size_t numThreads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return m_workers.size() + 1; }
+
+    /*
+     * Run task(0) .. task(count - 1) in parallel and wait for all of them.
+     * @param count - Number of tasks
+     * @param task - Called once per task index, possibly concurrently
+     */
+    void run(size_t count, const std::function<void(size_t)>& task);
+
+private:
+    void workerLoop();
+    // Claim and run tasks of the current job until none are left
+    void drain(std::unique_lock<std::mutex>& lock);
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_runMutex;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    const std::function<void(size_t)>* m_task;
+    size_t m_count;
+    size_t m_next;
+    size_t m_pending;
+    bool m_stop;
+};
+
+#endif // THREADPOOL_H
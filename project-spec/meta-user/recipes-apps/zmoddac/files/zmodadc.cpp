@@ -9,15 +9,21 @@
 #include <fstream>
 #include <signal.h>
 #include <sys/time.h>
+#include <time.h>
 // 添加netinet/tcp.h以支持TCP_NODELAY
 #include <netinet/tcp.h>
 
 #include "zmodlib/Zmod/zmod.h"
 #include "zmodlib/ZmodADC1410/zmodadc1410.h"
 
+#include "adccapture.h"
+#include "iqcodec.h"
+#include "benchutil.h"
+
 #define PORT 8080
 #define BUFFER_SIZE 8192
 #define TRANSFER_LEN 0x400  // ADC buffer size (1024 samples)
+#define CAPTURE_BUFFERS 8   // DMA buffers in the capture ring; the ADC fills one at a time
 #define IIC_BASE_ADDR 0xE0005000
 #define ZMOD_IRQ 61
 
@@ -44,12 +50,11 @@ uint64_t getCurrentTimeMs() {
     return (uint64_t)(tv.tv_sec) * 1000 + (tv.tv_usec / 1000);
 }
 
-// Function to acquire ADC data and format as string
-std::string acquireADCData(ZMODADC1410 &adcZmod, uint32_t *buffer, uint8_t channel, uint8_t gain, size_t length) {
+// Function to format a captured ADC block as string
+std::string formatADCBlock(ZMODADC1410 &adcZmod, const CaptureBlock &block, uint8_t channel, uint8_t gain) {
     std::stringstream dataStream;
-    
-    // Use immediate acquisition for higher speed
-    adcZmod.acquireImmediatePolling(buffer, length);
+    const uint32_t *buffer = block.buffer;
+    size_t length = block.length;
     
     // Format data for transmission
     char val_formatted[15];
@@ -103,19 +108,13 @@ int main() {
     // Set ADC gain for channel 0 (CH1)
     adcZmod.setGain(0, 0); // 0 for LOW gain
     
-    // Pre-allocate a fixed DMA buffer
-    size_t bufferLength = TRANSFER_LEN;
-    uint32_t *adcBuffer = adcZmod.allocChannelsBuffer(bufferLength);
-    
-    if (!adcBuffer) {
-        std::cerr << "Failed to allocate DMA buffer" << std::endl;
-        return 1;
-    }
+    // The capture thread re-arms the ADC into a ring of DMA buffers while streaming
+    ZmodAdcSource adcSource(&adcZmod);
+    AdcCaptureEngine capture(adcSource, TRANSFER_LEN, CAPTURE_BUFFERS);
     
     // Create socket
     if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
         perror("Socket creation failed");
-        adcZmod.freeChannelsBuffer(adcBuffer, bufferLength);
         return 1;
     }
     
@@ -123,7 +122,6 @@ int main() {
     int opt = 1;
     if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
         perror("setsockopt(SO_REUSEADDR) failed");
-        adcZmod.freeChannelsBuffer(adcBuffer, bufferLength);
         return 1;
     }
     
@@ -144,14 +142,12 @@ int main() {
     // Bind socket to port
     if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
         perror("Bind failed");
-        adcZmod.freeChannelsBuffer(adcBuffer, bufferLength);
         return 1;
     }
     
     // Listen for connections
     if (listen(server_fd, 1) < 0) {
         perror("Listen failed");
-        adcZmod.freeChannelsBuffer(adcBuffer, bufferLength);
         return 1;
     }
     
@@ -177,6 +173,8 @@ int main() {
         #endif
         
         bool streaming = false;
+        bool codedStream = false;     // "stream rice": lossless coded blocks instead of CSV text
+        std::vector<uint8_t> codedData;
         
         while (running) {
             // Check for client commands
@@ -195,10 +193,16 @@ int main() {
                 if (bytes_read > 0) {
                     printf("Received command: %s\n", buffer);
                     
-                    if (strcmp(buffer, "stream") == 0) {
+                    if (strcmp(buffer, "stream") == 0 || strcmp(buffer, "stream rice") == 0) {
                         // Start streaming mode
+                        if (!streaming && !capture.start()) {
+                            snprintf(buffer, BUFFER_SIZE, "Error: Failed to start capture");
+                            send(client_fd, buffer, strlen(buffer), 0);
+                            continue;
+                        }
                         streaming = true;
-                        printf("Starting streaming mode...\n");
+                        codedStream = strcmp(buffer, "stream rice") == 0;
+                        printf("Starting %sstreaming mode...\n", codedStream ? "coded " : "");
                         
                         // Send acknowledgment
                         snprintf(buffer, BUFFER_SIZE, "Streaming mode started");
@@ -210,6 +214,7 @@ int main() {
                     else if (strcmp(buffer, "stop") == 0) {
                         // Stop streaming mode
                         streaming = false;
+                        capture.stop();
                         printf("Streaming mode stopped\n");
                         
                         // Send acknowledgment
@@ -242,11 +247,37 @@ int main() {
             
             // Streaming mode: continuously send data
             if (streaming) {
-                // Get ADC data
-                std::string adcData = acquireADCData(adcZmod, adcBuffer, 0, 0, bufferLength);
+                // Get the next captured block, in order
+                CaptureBlock block;
+                if (!capture.next(block, 100000)) {
+                    continue;
+                }
+                if (block.stalled) {
+                    printf("Capture gap before block %llu\n", (unsigned long long)block.sequence);
+                }
+                std::string adcData;
+                const char* payload;
+                size_t payloadLength;
+                if (codedStream) {
+                    // Both channels as codes; the length line adds the pair count, ratio and encoder speed
+                    double started = monotonicSeconds();
+                    iqEncodeWords(block.buffer, block.length, codedData);
+                    double elapsed = monotonicSeconds() - started;
+                    const double rawBytes = block.length * 2.0 * sizeof(int16_t);
+                    payload = (const char*)codedData.data();
+                    payloadLength = codedData.size();
+                    snprintf(buffer, BUFFER_SIZE, "%zu PAIRS=%zu RATIO=%.2f MBPS=%.1f", payloadLength, block.length,
+                             payloadLength ? rawBytes / payloadLength : 1.0, elapsed > 0.0 ? rawBytes / elapsed / 1e6 : 0.0);
+                }
+                else {
+                    adcData = formatADCBlock(adcZmod, block, 0, 0);
+                    payload = adcData.c_str();
+                    payloadLength = adcData.length();
+                    snprintf(buffer, BUFFER_SIZE, "%zu", payloadLength);
+                }
+                capture.release(block);
                 
                 // Send data length first
-                snprintf(buffer, BUFFER_SIZE, "%zu", adcData.length());
                 if (send(client_fd, buffer, strlen(buffer), 0) < 0) {
                     perror("Send data length failed");
                     break;
@@ -276,7 +307,7 @@ int main() {
                 }
                 
                 // Send actual data
-                if (send(client_fd, adcData.c_str(), adcData.length(), 0) < 0) {
+                if (send(client_fd, payload, payloadLength, 0) < 0) {
                     perror("Send data failed");
                     break;
                 }
@@ -290,12 +321,13 @@ int main() {
             }
         }
         
+        capture.stop();
         close(client_fd);
         printf("Connection closed. Waiting for new connections...\n");
     }
     
     // Clean up
-    adcZmod.freeChannelsBuffer(adcBuffer, bufferLength);
+    capture.stop();
     
     close(server_fd);
     printf("Server shutdown complete\n");
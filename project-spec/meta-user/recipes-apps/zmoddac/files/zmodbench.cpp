@@ -0,0 +1,562 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zmodlib/Zmod/zmod.h"
+#include "zmodlib/ZmodDAC1411/zmoddac1411.h"
+#include "zmodlib/ZmodADC1410/zmodadc1410.h"
+
+#include "pilotcorr.h"
+#include "pilotsearch.h"
+#include "adccapture.h"
+#include "iqconvert.h"
+#include "threadpool.h"
+#include "fir.h"
+#include "carrier.h"
+#include "iqcodec.h"
+#include "benchutil.h"
+
+/*
+ * Benchmarks and self-checks of the DSP, capture and codec modules, kept out
+ * of the servers. Run it on the board while zmodstart is stopped, since it
+ * opens the same ZMOD devices:
+ *   zmodbench [all|kernels|detector|codec|trigger|capture|trigger_hw] [start pilot CSV]
+ * trigger_hw needs the DAC outputs looped back to the ADC inputs and is not
+ * part of all. The exit status is non-zero when a check fails.
+ */
+
+// DAC configuration, as in zmodstart
+#define DAC_BASE_ADDR 0x43C10000
+#define DAC_DMA_BASE_ADDR 0x40410000
+#define IIC_BASE_ADDR 0xE0005000
+#define DAC_FLASH_ADDR 0x31
+#define DAC_DMA_IRQ 63
+
+// ADC configuration
+#define ADC_BASE_ADDR 0x43C00000
+#define ADC_DMA_BASE_ADDR 0x40400000
+#define ADC_FLASH_ADDR 0x30
+#define ADC_DMA_IRQ 62
+#define ZMOD_IRQ 61
+
+#define DAC_GAIN 0
+#define ADC_GAIN 0
+#define ADC_SCALING_FACTOR 1
+
+// Kernel benchmark lengths: one receive batch, one full DAC waveform
+#define KERNEL_BENCH_LENGTH 500000
+#define DAC_BENCH_LENGTH 16384
+
+// Matched filter of the FIR benchmark, the receive defaults
+#define RRC_BENCH_ROLLOFF 0.25f
+#define RRC_BENCH_SPAN 20
+#define RRC_BENCH_SPS 20
+
+// ADC to DAC rate change applied by receive.m, resample(x, 21, 20)
+#define RESAMPLE_BENCH_UP 21
+#define RESAMPLE_BENCH_DOWN 20
+
+// NCO benchmark offset in radians per sample, about 100 kHz at 100 MHz
+#define NCO_BENCH_FREQUENCY 0.00628
+
+// Pilot saved by zmodstart on every pilot upload
+#define DEFAULT_PILOT_CSV "filtered_start_pilot.csv"
+
+// Synthetic captures of the detector benchmark, searched with the receive defaults
+#define BENCH_CAPTURE_LENGTH 262144
+#define BENCH_TRIALS 10
+#define BENCH_HIT_TOLERANCE 32      // Samples between first threshold crossing and true offset
+#define BENCH_DETECT_THRESHOLD 0.5f
+#define BENCH_COARSE_DECIMATION 8
+#define BENCH_COARSE_THRESHOLD 0.3f
+#define FIXED_DETECTOR_TOLERANCE 1e-3f
+
+// Sample codec benchmark
+#define CODEC_BENCH_LENGTH 500000
+#define CODEC_BENCH_ROUNDS 4
+#define CODEC_BENCH_NOISE 6         // Peak idle noise of the simulated ADC, in codes
+#define CODEC_BENCH_BURST 2000
+
+// Level-trigger check on the simulated ADC, all lengths and levels in samples and raw codes
+#define TRIGGER_CHECK_TRIALS 8
+#define TRIGGER_CHECK_WINDOW 1024
+#define TRIGGER_CHECK_LENGTH 16384
+#define TRIGGER_CHECK_SPREAD (1 << 20)  // Bursts start up to this many samples into the stream
+#define TRIGGER_CHECK_NOISE 40
+#define TRIGGER_CHECK_BURST 2000
+#define TRIGGER_CHECK_LEVEL 1000
+#define TRIGGER_CHECK_TIMEOUT 1.0
+#define TRIGGER_CHECK_MISS_TIMEOUT 0.01
+
+// Hardware level-trigger check: DAC step waveform, repeated, and step height in volts
+#define TRIGGER_HW_WAVE_LENGTH 16384
+#define TRIGGER_HW_STEP 0.5f
+
+// Capture engine continuity check on a simulated ramp
+#define CAPTURE_CHECK_BLOCK 4096
+#define CAPTURE_CHECK_BUFFERS 4
+#define CAPTURE_CHECK_BLOCKS 256
+#define CAPTURE_CHECK_STALL_AT 100     // From this block on the consumer holds every buffer once
+#define CAPTURE_CHECK_STALL_US 20000
+
+ZMODDAC1411* g_dacZmod = NULL;
+ZMODADC1410* g_adcZmod = NULL;
+AdcIqConverter* g_adcConverter = NULL;
+DacIqPacker* g_dacPacker = NULL;
+ThreadPool* g_threadPool = NULL;
+
+// Throughput of the conversion and DSP kernels, with the resampler and NCO checked against references
+bool benchmarkKernels() {
+    std::ostringstream report;
+    report << "Kernel benchmark\n";
+    g_adcConverter->benchmark(KERNEL_BENCH_LENGTH, report);
+    g_dacPacker->benchmark(DAC_BENCH_LENGTH, report);
+    FirDecimator(designRootRaisedCosine(RRC_BENCH_ROLLOFF, RRC_BENCH_SPAN, RRC_BENCH_SPS), RRC_BENCH_SPS)
+        .benchmark(KERNEL_BENCH_LENGTH, report);
+    RationalResampler(RESAMPLE_BENCH_UP, RESAMPLE_BENCH_DOWN).benchmark(KERNEL_BENCH_LENGTH, report);
+    Nco(NCO_BENCH_FREQUENCY, 0.0).benchmark(KERNEL_BENCH_LENGTH, report);
+    std::cout << report.str();
+    return true;
+}
+
+// Read a pilot in the Index,Real,Imag,Magnitude layout zmodstart saves
+bool loadPilot(const char* path, std::vector<std::complex<float>>& pilot) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    std::string line;
+    std::getline(file, line);
+    pilot.clear();
+    while (std::getline(file, line)) {
+        int index;
+        float real;
+        float imag;
+        if (sscanf(line.c_str(), "%d,%f,%f", &index, &real, &imag) == 3) {
+            pilot.push_back(std::complex<float>(real, imag));
+        }
+    }
+    return !pilot.empty();
+}
+
+/*
+ * Detector benchmark on synthetic captures: the start pilot is placed at a random
+ * offset in complex Gaussian noise at several SNRs, and the exhaustive and the
+ * coarse-to-fine searches are timed on each capture, with the float and, when it
+ * passes its conformance check, the Q15 detector. A trial is a miss when the
+ * first threshold crossing is not within BENCH_HIT_TOLERANCE samples of the offset.
+ */
+bool benchmarkDetector(const char* pilotPath) {
+    std::vector<std::complex<float>> pilot;
+    if (!loadPilot(pilotPath, pilot) || pilot.size() >= BENCH_CAPTURE_LENGTH) {
+        std::cout << "Detector benchmark: no usable pilot in " << pilotPath << ", skipped\n";
+        return true;
+    }
+
+    static const int snrsDb[] = { -6, -3, 0, 3, 6, 10, 20 };
+    PilotDetector detector;
+    detector.correlator.setPilot(pilot);
+    detector.coarseCorrelator.setPilot(pilot, BENCH_COARSE_DECIMATION);
+    detector.fixedCorrelator.setPilot(pilot, g_adcConverter->scale(), g_adcConverter->offset());
+    const bool fixedValid = fixedCorrelationError(detector.correlator, detector.fixedCorrelator) <= FIXED_DETECTOR_TOLERANCE;
+    const PilotSearchContext context = { g_adcConverter, g_threadPool, BENCH_COARSE_THRESHOLD, 0.0f };
+
+    const size_t pilotLength = pilot.size();
+    const size_t count = BENCH_CAPTURE_LENGTH - pilotLength + 1;
+    const float pilotPower = detector.correlator.energy() / pilotLength;
+    const float scale = g_adcConverter->scale();
+    const float offset = g_adcConverter->offset();
+
+    std::vector<uint32_t> words(BENCH_CAPTURE_LENGTH);
+    std::vector<float> score(count);
+    std::vector<float> magnitude(count);
+
+    for (int fixedPass = 0; fixedPass < (fixedValid ? 2 : 1); fixedPass++) {
+        const bool useFixed = fixedPass == 1;
+        std::mt19937 rng(1);
+        std::normal_distribution<float> gaussian(0.0f, 1.0f);
+        std::uniform_int_distribution<size_t> placement(0, count - 1);
+
+        std::cout << "Detector benchmark (" << (useFixed ? "q15" : "float") << ")\n";
+        for (int snrDb : snrsDb) {
+            const float noiseSigma = std::sqrt(pilotPower / std::pow(10.0f, snrDb / 10.0f) / 2.0f);
+            int exhaustiveMisses = 0;
+            int coarseMisses = 0;
+            double exhaustiveSeconds = 0.0;
+            double coarseSeconds = 0.0;
+            size_t refined = 0;
+
+            for (int trial = 0; trial < BENCH_TRIALS; trial++) {
+                // Noise plus the pilot, quantised to ADC words like a real capture
+                size_t truth = placement(rng);
+                for (size_t n = 0; n < BENCH_CAPTURE_LENGTH; n++) {
+                    std::complex<float> value(noiseSigma * gaussian(rng), noiseSigma * gaussian(rng));
+                    if (n >= truth && n < truth + pilotLength) {
+                        value += pilot[n - truth];
+                    }
+                    int codeI = std::max(-8192, std::min(8191, (int)std::lrint((value.real() - offset) / scale)));
+                    int codeQ = std::max(-8192, std::min(8191, (int)std::lrint((value.imag() - offset) / scale)));
+                    words[n] = ((uint32_t)codeI << 18) | (((uint32_t)codeQ << 2) & 0xFFFCu);
+                }
+
+                for (int pass = 0; pass < 2; pass++) {
+                    SearchMode mode = (pass == 0) ? SEARCH_EXHAUSTIVE : SEARCH_COARSE;
+                    double started = monotonicSeconds();
+                    size_t scored = searchPilot(context, detector, useFixed, mode, words.data(), count,
+                                                score.data(), magnitude.data());
+                    double elapsed = monotonicSeconds() - started;
+
+                    size_t detected = std::find_if(score.begin(), score.end(),
+                                                   [](float v) { return v > BENCH_DETECT_THRESHOLD; }) - score.begin();
+                    bool hit = detected < count &&
+                               (detected > truth ? detected - truth : truth - detected) <= BENCH_HIT_TOLERANCE;
+                    if (pass == 0) {
+                        exhaustiveSeconds += elapsed;
+                        exhaustiveMisses += hit ? 0 : 1;
+                    } else {
+                        coarseSeconds += elapsed;
+                        coarseMisses += hit ? 0 : 1;
+                        refined += scored;
+                    }
+                }
+            }
+
+            printf("SNR %3d dB: miss exhaustive %d/%d, coarse %d/%d; %.2f ms vs %.2f ms, speedup %.1fx, refined %.2f%%\n",
+                   snrDb, exhaustiveMisses, BENCH_TRIALS, coarseMisses, BENCH_TRIALS,
+                   1e3 * exhaustiveSeconds / BENCH_TRIALS, 1e3 * coarseSeconds / BENCH_TRIALS,
+                   coarseSeconds > 0.0 ? exhaustiveSeconds / coarseSeconds : 0.0,
+                   100.0 * refined / ((double)count * BENCH_TRIALS));
+        }
+    }
+    if (!fixedValid) {
+        std::cout << "Q15 detector failed its conformance check, not benchmarked\n";
+    }
+    return true;
+}
+
+/*
+ * Ratio, speed and losslessness of the sample codec on one capture.
+ * @return false when the decoded codes differ from the capture
+ */
+bool benchmarkCodec(const char* name, const std::vector<uint32_t>& words) {
+    const size_t count = words.size();
+    const double rawBytes = count * 2.0 * sizeof(int16_t);
+    std::vector<uint8_t> coded;
+    std::vector<int16_t> expected(2 * count);
+    std::vector<int16_t> decoded(2 * count);
+    g_adcConverter->unpackRaw(words.data(), count, expected.data());
+
+    double encodeSeconds = 0.0;
+    double decodeSeconds = 0.0;
+    bool lossless = true;
+    for (int round = 0; round < CODEC_BENCH_ROUNDS; round++) {
+        double started = monotonicSeconds();
+        iqEncodeWords(words.data(), count, coded);
+        double encoded = monotonicSeconds();
+        lossless = iqDecode(coded.data(), coded.size(), count, decoded.data()) && lossless;
+        decodeSeconds += monotonicSeconds() - encoded;
+        encodeSeconds += encoded - started;
+    }
+    lossless = lossless && decoded == expected;
+
+    printf("%s: %zu samples, ratio %.2f, encode %.1f MB/s, decode %.1f MB/s, %s\n",
+           name, count, coded.empty() ? 1.0 : rawBytes / coded.size(),
+           rawBytes * CODEC_BENCH_ROUNDS / encodeSeconds / 1e6, rawBytes * CODEC_BENCH_ROUNDS / decodeSeconds / 1e6,
+           lossless ? "lossless" : "MISMATCH");
+    return lossless;
+}
+
+// Sample codec on a live ADC capture and on simulated idle noise with and without bursts
+bool benchmarkCodecs() {
+    std::vector<uint32_t> words(CODEC_BENCH_LENGTH);
+    std::cout << "Codec benchmark (ratio against int16 codes)\n";
+    bool lossless = true;
+
+    ZmodAdcSource adcSource(g_adcZmod);
+    uint32_t* buffer = adcSource.allocBlock(CODEC_BENCH_LENGTH);
+    if (buffer && adcSource.acquire(buffer, CODEC_BENCH_LENGTH)) {
+        std::copy(buffer, buffer + CODEC_BENCH_LENGTH, words.begin());
+        lossless = benchmarkCodec("ADC capture", words) && lossless;
+    } else {
+        std::cout << "ADC capture: no DMA buffer or ADC busy, skipped\n";
+    }
+    if (buffer) {
+        adcSource.freeBlock(buffer, CODEC_BENCH_LENGTH);
+    }
+
+    SimulatedAdcSource idle(CODEC_BENCH_NOISE, 1);
+    idle.acquire(words.data(), words.size());
+    lossless = benchmarkCodec("Idle noise", words) && lossless;
+
+    SimulatedAdcSource bursts(CODEC_BENCH_NOISE, 2);
+    for (size_t start = 0; start < CODEC_BENCH_LENGTH; start += CODEC_BENCH_LENGTH / 8) {
+        bursts.injectBurst(start, CODEC_BENCH_LENGTH / 32, CODEC_BENCH_BURST);
+    }
+    bursts.acquire(words.data(), words.size());
+    lossless = benchmarkCodec("Noise with bursts", words) && lossless;
+    return lossless;
+}
+
+// Trigger of one check trial: alternating edge, then channel
+AdcTrigger checkTrial(int trial, int32_t level, double timeout) {
+    const bool falling = (trial & 1) != 0;
+    AdcTrigger trigger;
+    trigger.channel = (uint8_t)((trial >> 1) & 1);
+    trigger.level = falling ? -level : level;
+    trigger.edge = falling ? TRIGGER_FALLING : TRIGGER_RISING;
+    trigger.window = TRIGGER_CHECK_WINDOW;
+    trigger.timeout = timeout;
+    return trigger;
+}
+
+/*
+ * Level-trigger check on the simulated ADC: a burst is injected at a random
+ * offset into noise, alternating channel and edge, and one acquisition is made
+ * the way the receive path makes it. The expected buffer is the same stream
+ * read without a trigger, starting the pre-trigger window before the burst, so
+ * a trial passes only when the trigger fired on the burst's first sample and
+ * the crossing is reported right after the window. A last trial sets the level
+ * beyond the burst and must time out.
+ */
+bool checkTrigger() {
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<uint64_t> placement(TRIGGER_CHECK_WINDOW, TRIGGER_CHECK_SPREAD);
+    std::vector<uint32_t> words(TRIGGER_CHECK_LENGTH);
+    std::vector<uint32_t> expected;
+
+    std::cout << "Level trigger check\n";
+    int failures = 0;
+    for (int trial = 0; trial < TRIGGER_CHECK_TRIALS; trial++) {
+        const AdcTrigger trigger = checkTrial(trial, TRIGGER_CHECK_LEVEL, TRIGGER_CHECK_TIMEOUT);
+        const int32_t burstLevel = trigger.edge == TRIGGER_FALLING ? -TRIGGER_CHECK_BURST : TRIGGER_CHECK_BURST;
+        const uint64_t burstStart = placement(rng);
+        const uint32_t seed = (uint32_t)rng();
+
+        SimulatedAdcSource source(TRIGGER_CHECK_NOISE, seed);
+        source.injectBurst(burstStart, TRIGGER_CHECK_LENGTH, burstLevel);
+        size_t crossing;
+        bool acquired = acquireLevelTriggered(source, words.data(), words.size(), trigger, crossing);
+
+        // The stream from the window before the burst on, read straight
+        SimulatedAdcSource reference(TRIGGER_CHECK_NOISE, seed);
+        reference.injectBurst(burstStart, TRIGGER_CHECK_LENGTH, burstLevel);
+        expected.resize(burstStart - trigger.window);
+        reference.acquire(expected.data(), expected.size());
+        expected.resize(words.size());
+        reference.acquire(expected.data(), expected.size());
+
+        bool aligned = acquired && crossing == trigger.window && words == expected;
+        failures += aligned ? 0 : 1;
+        printf("Trial %d: channel %d %s, burst at %llu, crossing at %lld, window %u: %s\n",
+               trial, trigger.channel + 1, trigger.edge == TRIGGER_FALLING ? "falling" : "rising",
+               (unsigned long long)burstStart, crossing < words.size() ? (long long)crossing : -1LL,
+               trigger.window, aligned ? "ok" : "MISALIGNED");
+    }
+
+    AdcTrigger unreachable = checkTrial(0, 2 * TRIGGER_CHECK_BURST, TRIGGER_CHECK_MISS_TIMEOUT);
+    SimulatedAdcSource source(TRIGGER_CHECK_NOISE, 1);
+    source.injectBurst(TRIGGER_CHECK_WINDOW, TRIGGER_CHECK_LENGTH, TRIGGER_CHECK_BURST);
+    size_t crossing;
+    bool timedOut = !acquireLevelTriggered(source, words.data(), words.size(), unreachable, crossing);
+    failures += timedOut ? 0 : 1;
+    printf("Level beyond the burst: %s\n", timedOut ? "timed out, ok" : "TRIGGERED");
+
+    printf("%d/%d trials passed\n", TRIGGER_CHECK_TRIALS + 1 - failures, TRIGGER_CHECK_TRIALS + 1);
+    return failures == 0;
+}
+
+/*
+ * Level-trigger check on the ZMOD, with the DAC outputs looped back to the ADC
+ * inputs as for a receive. The DAC repeats a waveform that is zero for its
+ * first half and TRIGGER_HW_STEP volts for the second on both channels, and
+ * each trial triggers halfway up the step on one channel and edge. The library
+ * converts the samples on either side of the pre-trigger window, which must
+ * lie on either side of the level.
+ */
+bool checkTriggerHardware() {
+    std::vector<float> step(TRIGGER_HW_WAVE_LENGTH, 0.0f);
+    std::fill(step.begin() + TRIGGER_HW_WAVE_LENGTH / 2, step.end(), TRIGGER_HW_STEP);
+    uint32_t* wave = g_dacZmod->allocChannelsBuffer(TRIGGER_HW_WAVE_LENGTH);
+    ZmodAdcSource adcSource(g_adcZmod);
+    uint32_t* buffer = adcSource.allocBlock(TRIGGER_CHECK_LENGTH);
+    if (!wave || !buffer) {
+        std::cout << "Hardware level trigger check: no DMA buffer\n";
+        return false;
+    }
+    g_dacPacker->pack(step.data(), step.data(), TRIGGER_HW_WAVE_LENGTH, wave);
+    g_dacZmod->setOutputSampleFrequencyDivider(0);
+    g_dacZmod->setGain(0, DAC_GAIN);
+    g_dacZmod->setGain(1, DAC_GAIN);
+    g_dacZmod->setData(wave, TRIGGER_HW_WAVE_LENGTH);
+    g_dacZmod->start();
+
+    std::cout << "Hardware level trigger check\n";
+    const int32_t level = g_adcZmod->getSignedRawFromVolt(TRIGGER_HW_STEP / 2 / ADC_SCALING_FACTOR, ADC_GAIN);
+    int failures = 0;
+    for (int trial = 0; trial < TRIGGER_CHECK_TRIALS; trial++) {
+        // The step goes up from zero, so both edges trigger on the positive level
+        AdcTrigger trigger = checkTrial(trial, level, TRIGGER_CHECK_TIMEOUT);
+        trigger.level = level;
+        size_t crossing;
+        bool acquired = acquireLevelTriggered(adcSource, buffer, TRIGGER_CHECK_LENGTH, trigger, crossing);
+        int32_t before = 0;
+        int32_t at = 0;
+        bool aligned = false;
+        if (acquired) {
+            before = g_adcZmod->signedChannelData(trigger.channel, buffer[trigger.window - 1]);
+            at = g_adcZmod->signedChannelData(trigger.channel, buffer[trigger.window]);
+            aligned = trigger.edge == TRIGGER_RISING ? (before < level && at >= level) : (before > level && at <= level);
+        }
+        failures += aligned ? 0 : 1;
+        printf("Trial %d: channel %d %s at code %d: %s, codes %d then %d around the window, crossing at %lld: %s\n",
+               trial, trigger.channel + 1, trigger.edge == TRIGGER_FALLING ? "falling" : "rising", level,
+               acquired ? "triggered" : "TIMED OUT", before, at,
+               crossing < TRIGGER_CHECK_LENGTH ? (long long)crossing : -1LL, aligned ? "ok" : "MISALIGNED");
+    }
+    printf("%d/%d trials aligned\n", TRIGGER_CHECK_TRIALS - failures, TRIGGER_CHECK_TRIALS);
+
+    g_dacZmod->stop();
+    adcSource.freeBlock(buffer, TRIGGER_CHECK_LENGTH);
+    g_dacZmod->freeChannelsBuffer(wave, TRIGGER_HW_WAVE_LENGTH);
+    return failures == 0;
+}
+
+/*
+ * Capture engine check on a simulated ramp, where every word is its stream
+ * index. The simulated source is continuous, so the blocks must come out in
+ * sequence with every word one above the word before it, also across block
+ * boundaries, and a stall forced by holding every buffer must be flagged. The
+ * simulated source is faster than the consumer, so it stalls on its own too;
+ * every stall has to be flagged and counted alike. This checks the engine's
+ * ordering, buffer recycling and stall flagging only: the ZMOD source re-arms
+ * for every block and is not continuous.
+ */
+bool checkCapture() {
+    SimulatedAdcSource source(0, 1);
+    source.setRamp(true);
+    AdcCaptureEngine capture(source, CAPTURE_CHECK_BLOCK, CAPTURE_CHECK_BUFFERS);
+    if (!capture.start()) {
+        std::cout << "Capture check: failed to start capture\n";
+        return false;
+    }
+
+    std::vector<CaptureBlock> held;
+    uint32_t expectedWord = 0;
+    int received = 0;
+    int mismatches = 0;
+    int misplaced = 0;
+    int stalledBlocks = 0;
+    int unflagged = 0;
+    bool forcedStallSeen = false;
+    for (; received < CAPTURE_CHECK_BLOCKS; received++) {
+        CaptureBlock block;
+        if (!capture.next(block, 1000000)) {
+            break;
+        }
+        for (size_t n = 0; n < block.length; n++) {
+            if (block.buffer[n] != expectedWord + (uint32_t)n) {
+                mismatches++;
+                break;
+            }
+        }
+        if (block.sequence != (uint64_t)received) {
+            misplaced++;
+        }
+        expectedWord = block.buffer[block.length - 1] + 1;
+        stalledBlocks += block.stalled ? 1 : 0;
+        unflagged += (block.stalled && !block.discontinuity) ? 1 : 0;
+        if (received == CAPTURE_CHECK_STALL_AT + CAPTURE_CHECK_BUFFERS) {
+            // Captured after every buffer was held
+            forcedStallSeen = block.stalled;
+        }
+
+        // Hold every buffer once so the capture thread has to wait
+        if (received >= CAPTURE_CHECK_STALL_AT && held.size() < CAPTURE_CHECK_BUFFERS &&
+            received < CAPTURE_CHECK_STALL_AT + CAPTURE_CHECK_BUFFERS) {
+            held.push_back(block);
+            if (held.size() == CAPTURE_CHECK_BUFFERS) {
+                usleep(CAPTURE_CHECK_STALL_US);
+                for (const CaptureBlock& heldBlock : held) {
+                    capture.release(heldBlock);
+                }
+            }
+            continue;
+        }
+        capture.release(block);
+    }
+    capture.stop();
+
+    const bool passed = received == CAPTURE_CHECK_BLOCKS && mismatches == 0 && misplaced == 0 &&
+                        forcedStallSeen && unflagged == 0 && (uint64_t)stalledBlocks == capture.stalls();
+    printf("Capture check: %d/%d blocks, %d not continuing the ramp, %d out of sequence, "
+           "%d stalled (engine counted %llu, %d not flagged as discontinuity), forced stall %s: %s\n",
+           received, CAPTURE_CHECK_BLOCKS, mismatches, misplaced, stalledBlocks,
+           (unsigned long long)capture.stalls(), unflagged, forcedStallSeen ? "flagged" : "MISSED",
+           passed ? "ok" : "FAILED");
+    return passed;
+}
+
+// Release the converters and the ZMOD devices
+void releaseHardware() {
+    delete g_adcConverter;
+    delete g_dacPacker;
+    delete g_dacZmod;
+    delete g_adcZmod;
+    delete g_threadPool;
+}
+
+int main(int argc, char* argv[]) {
+    const char* which = argc > 1 ? argv[1] : "all";
+    const char* pilotPath = argc > 2 ? argv[2] : DEFAULT_PILOT_CSV;
+    const bool all = strcmp(which, "all") == 0;
+    if (!all && strcmp(which, "kernels") != 0 && strcmp(which, "detector") != 0 && strcmp(which, "codec") != 0 &&
+        strcmp(which, "trigger") != 0 && strcmp(which, "capture") != 0 && strcmp(which, "trigger_hw") != 0) {
+        fprintf(stderr, "Usage: %s [all|kernels|detector|codec|trigger|capture|trigger_hw] [start pilot CSV]\n",
+                argv[0]);
+        return 2;
+    }
+
+    // The converters take their calibration from the ZMOD flash
+    g_dacZmod = new ZMODDAC1411(DAC_BASE_ADDR, DAC_DMA_BASE_ADDR, IIC_BASE_ADDR, DAC_FLASH_ADDR, DAC_DMA_IRQ);
+    g_adcZmod = new ZMODADC1410(ADC_BASE_ADDR, ADC_DMA_BASE_ADDR, IIC_BASE_ADDR, ADC_FLASH_ADDR,
+                                ZMOD_IRQ, ADC_DMA_IRQ);
+    g_adcZmod->setGain(0, ADC_GAIN);
+    g_adcZmod->setGain(1, ADC_GAIN);
+    g_adcConverter = new AdcIqConverter(g_adcZmod, ADC_GAIN, ADC_SCALING_FACTOR);
+    g_dacPacker = new DacIqPacker(g_dacZmod, DAC_GAIN);
+    g_threadPool = new ThreadPool(std::max(1u, std::thread::hardware_concurrency()));
+
+    bool passed = true;
+    if (all || strcmp(which, "kernels") == 0) {
+        passed = benchmarkKernels() && passed;
+    }
+    if (all || strcmp(which, "detector") == 0) {
+        passed = benchmarkDetector(pilotPath) && passed;
+    }
+    if (all || strcmp(which, "codec") == 0) {
+        passed = benchmarkCodecs() && passed;
+    }
+    if (all || strcmp(which, "trigger") == 0) {
+        passed = checkTrigger() && passed;
+    }
+    if (all || strcmp(which, "capture") == 0) {
+        passed = checkCapture() && passed;
+    }
+    if (strcmp(which, "trigger_hw") == 0) {
+        passed = checkTriggerHardware() && passed;
+    }
+
+    releaseHardware();
+    std::cout << (passed ? "All checks passed" : "CHECKS FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -4,12 +4,15 @@
 #include <string.h>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
 #include <arpa/inet.h>
 #include <stdbool.h>
 
 #include "zmodlib/Zmod/zmod.h"
 #include "zmodlib/ZmodDAC1411/zmoddac1411.h"
 
+#include "iqconvert.h"
+
 #define PORT 8080
 #define BUFFER_SIZE 8192
 #define MAX_SAMPLES 16383  // (1<<14) - 1, maximum buffer size
@@ -22,9 +25,29 @@
 #define DAC_FLASH_ADDR      0x31
 #define DAC_DMA_IRQ         63
 
+// Output gain settings of the DAC: 0 low, 1 high
+#define DAC_GAIN_COUNT 2
+
+// Debug samples printed from the start and from the end of an upload
+#define DEBUG_HEAD_SAMPLES 10
+#define DEBUG_TAIL_SAMPLES 9
+
 // Global ZMOD DAC object to be shared across functions
 ZMODDAC1411* g_dacZmod = NULL;
 
+// Volt-to-code packers for each gain, built once at startup
+DacIqPacker* g_dacPackers[DAC_GAIN_COUNT] = { NULL, NULL };
+
+// Free the packers and the DAC
+void releaseDac() {
+    for (int gain = 0; gain < DAC_GAIN_COUNT; gain++) {
+        delete g_dacPackers[gain];
+        g_dacPackers[gain] = NULL;
+    }
+    delete g_dacZmod;
+    g_dacZmod = NULL;
+}
+
 /*
  * Generate DAC waveforms from complex data and output to both channels
  * @param realData - Array of real part data
@@ -40,6 +63,10 @@ void dacGenerateFromComplex(float* realData, float* imagData, int numSamples,
         std::cerr << "DAC not initialized!" << std::endl;
         return;
     }
+    if (gain >= DAC_GAIN_COUNT) {
+        std::cerr << "Invalid DAC gain " << (int)gain << std::endl;
+        return;
+    }
     
     // Ensure sample count doesn't exceed maximum buffer size
     if (numSamples > MAX_SAMPLES) {
@@ -62,29 +89,25 @@ void dacGenerateFromComplex(float* realData, float* imagData, int numSamples,
     g_dacZmod->setGain(1, gain); // Channel 2 (imaginary)
     
     // Prepare data for both channels
-    // Channel 1 (0) for real part, Channel 2 (1) for imaginary part
-    for (int i = 0; i < numSamples; i++) {
-        // Process real part for Channel 1
-        int16_t realRaw = g_dacZmod->getSignedRawFromVolt(realData[i], gain);
-        
-        // Process imaginary part for Channel 2
-        int16_t imagRaw = g_dacZmod->getSignedRawFromVolt(imagData[i], gain);
-        
-        // Combine both channels' data into a single 32-bit word
-        // Each channel gets its own position in the 32-bit value
-        uint32_t realValBuf = g_dacZmod->arrangeChannelData(0, realRaw);  // Channel 1
-        uint32_t imagValBuf = g_dacZmod->arrangeChannelData(1, imagRaw);  // Channel 2
-        
-        // Combine both channel values
-        buf[i] = realValBuf | imagValBuf;
-        
-        // Print some debug info for the first and last few samples
-        if (i < 10 || i > numSamples - 10) {
-            std::cout << "Sample[" << i << "]: real=" << realData[i] 
-                      << ", imag=" << imagData[i]
-                      << ", real_raw=" << realRaw 
-                      << ", imag_raw=" << imagRaw << std::endl;
-        }
+    // Channel 1 (0) for real part, Channel 2 (1) for imaginary part,
+    // converted and packed straight into the DMA buffer
+    g_dacPackers[gain]->pack(realData, imagData, numSamples, buf);
+    
+    // Print some debug info for the first and last few samples
+    auto printSample = [&](int i) {
+        int16_t realRaw = (int32_t)buf[i] >> 18;
+        int16_t imagRaw = (int32_t)(buf[i] << 16) >> 18;
+        std::cout << "Sample[" << i << "]: real=" << realData[i] 
+                  << ", imag=" << imagData[i]
+                  << ", real_raw=" << realRaw 
+                  << ", imag_raw=" << imagRaw << std::endl;
+    };
+    const int head = std::min(numSamples, DEBUG_HEAD_SAMPLES);
+    for (int i = 0; i < head; i++) {
+        printSample(i);
+    }
+    for (int i = std::max(head, numSamples - DEBUG_TAIL_SAMPLES); i < numSamples; i++) {
+        printSample(i);
     }
     
     // Send data to DAC and start output
@@ -101,6 +124,9 @@ int main() {
         std::cerr << "Failed to initialize DAC!" << std::endl;
         return 1;
     }
+    for (int gain = 0; gain < DAC_GAIN_COUNT; gain++) {
+        g_dacPackers[gain] = new DacIqPacker(g_dacZmod, gain);
+    }
 
     // Create TCP server
     int server_fd, client_fd;
@@ -111,7 +137,7 @@ int main() {
     // Create socket
     if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
         perror("Socket creation failed");
-        delete g_dacZmod;
+        releaseDac();
         return 1;
     }
 
@@ -123,14 +149,14 @@ int main() {
     // Bind socket to port
     if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
         perror("Bind failed");
-        delete g_dacZmod;
+        releaseDac();
         return 1;
     }
 
     // Listen for connections
     if (listen(server_fd, 1) < 0) {
         perror("Listen failed");
-        delete g_dacZmod;
+        releaseDac();
         return 1;
     }
 
@@ -139,7 +165,7 @@ int main() {
     // Accept client connection
     if ((client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &client_len)) < 0) {
         perror("Accept failed");
-        delete g_dacZmod;
+        releaseDac();
         return 1;
     }
 
@@ -254,8 +280,8 @@ int main() {
     // Stop DAC and release
     if (g_dacZmod) {
         g_dacZmod->stop();
-        delete g_dacZmod;
     }
+    releaseDac();
     
     return 0;
 }
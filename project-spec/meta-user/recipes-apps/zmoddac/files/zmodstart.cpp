@@ -12,13 +12,31 @@
 #include <algorithm>
 #include <complex>
 #include <cmath>
+#include <memory>
 #include <random>
+#include <string>
+#include <time.h>
 
 // Include ZMOD library
 #include "zmodlib/Zmod/zmod.h"
 #include "zmodlib/ZmodDAC1411/zmoddac1411.h"
 #include "zmodlib/ZmodADC1410/zmodadc1410.h"
 
+#include "pilotcorr.h"
+#include "pilotsearch.h"
+#include "adccapture.h"
+#include "dmapool.h"
+#include "iqconvert.h"
+#include "threadpool.h"
+#include "capturestore.h"
+#include "fir.h"
+#include "demod.h"
+#include "carrier.h"
+#include "protocol.h"
+#include "packed14.h"
+#include "iqcodec.h"
+#include "benchutil.h"
+
 // Configuration constants
 #define SERVER_PORT 8080
 #define BUFFER_SIZE 8192
@@ -48,11 +66,100 @@
 // ADC scaling factor to match DAC amplitude
 #define ADC_SCALING_FACTOR 1
 
+// Write every received sample to sample_trace.csv (slow, debugging only)
+#define ENABLE_SAMPLE_TRACE 0
+
+// Number of DMA buffers in the capture engine's ring
+#define ACQ_BUFFER_COUNT 4
+
+// ADC samples per receive batch
+#define ADC_BATCH_SIZE 500000
+
+// DMA pool size classes (32-bit words), reserved at startup. Together they
+// take about 8.2 MB of the 25 MB CMA region set in the boot arguments.
+#define ADC_POOL_SMALL_LENGTH 1024      // Hardware reset / flush transfers
+#define DAC_POOL_WAVE_LENGTH 16384      // Full DAC waveform memory
+#define DAC_POOL_WAVE_COUNT 2
+#define DAC_ZERO_LENGTH 1024            // Idle waveform, permanently resident
+
+// The DAC holds its last code once stopped, so the zero waveform plays this long
+// (microseconds) before the stop to bring the output back to 0 V
+#define DAC_ZERO_SETTLE_US 10000
+
+// Uploaded DAC samples printed from the start and from the end
+#define DAC_DEBUG_HEAD_SAMPLES 5
+#define DAC_DEBUG_TAIL_SAMPLES 4
+
+// Stored raw words converted at a time for the batch statistics
+#define CONVERT_CHUNK_LENGTH 4096
+
+// Largest score difference allowed between the Q15 and float detectors
+#define FIXED_DETECTOR_TOLERANCE 1e-3f
+
+// Default full-rate detection threshold of both pilots
+#define PILOT_DETECT_THRESHOLD 0.5f
+
+// Coarse-to-fine search defaults
+#define COARSE_DEFAULT_DECIMATION 8
+#define COARSE_MAX_DECIMATION 64
+#define COARSE_DEFAULT_THRESHOLD 0.3f
+
+// Default and largest memory cap of the receive capture store
+#define CAPTURE_DEFAULT_LIMIT_MB 128
+#define CAPTURE_MAX_LIMIT_MB 1024
+
+// Frame-sized capture window: ADC samples per DAC sample (105 MHz / 100 MHz, as in
+// wrapper.m) and the default and largest guard factor on the window
+#define ADC_PER_DAC_SAMPLE (105.0 / 100.0)
+// The same rate change as resample=P/Q factors: 20/21 takes ADC samples back to the DAC rate
+#define ADC_TO_DAC_UP 20
+#define ADC_TO_DAC_DOWN 21
+#define ADC_SAMPLES_PER_SECOND 100000000
+#define CAPTURE_DEFAULT_GUARD 1.25f
+#define CAPTURE_MAX_GUARD 16.0f
+
+// Pilot-triggered capture: default and largest pre- and post-trigger lengths in samples
+#define TRIGGER_DEFAULT_PRETRIGGER 4096
+#define TRIGGER_DEFAULT_POSTTRIGGER 262144
+#define TRIGGER_MAX_LENGTH (16 * 1024 * 1024)
+
+// Hardware level trigger: default level and largest level magnitude in volts
+#define TRIGGER_DEFAULT_LEVEL 0.05f
+#define TRIGGER_MAX_LEVEL 25.0f
+// Seconds a level-triggered acquisition waits for its trigger, as long as any receive collects
+#define TRIGGER_TIMEOUT 1.0
+
+// Receive-side RRC matched filter defaults, as used by receive.m
+#define RRC_DEFAULT_ROLLOFF 0.25f
+#define RRC_DEFAULT_SPAN 20
+#define RRC_DEFAULT_SPS 20
+#define RRC_MAX_SPAN 64
+#define RRC_MAX_SPS 64
+
+// Largest interpolation or decimation factor of the receive resampler
+#define RESAMPLE_MAX_FACTOR 64
+
+// Multi-frame receive: most frames per reply, and positions scored per pass of the frame scan
+#define MAX_RECEIVE_FRAMES 1024
+#define FRAME_SCAN_CHUNK_LENGTH (1 << 20)
+
 // Global variables
 volatile bool running = true;
 ZMODDAC1411* g_dacZmod = NULL;
 ZMODADC1410* g_adcZmod = NULL;
 
+// Pre-mapped DMA buffers for each device
+DmaBufferPool* g_adcPool = NULL;
+DmaBufferPool* g_dacPool = NULL;
+DmaLease g_dacZeroWave;
+
+// Bulk ADC word to calibrated I/Q conversion and DAC word packing
+AdcIqConverter* g_adcConverter = NULL;
+DacIqPacker* g_dacPacker = NULL;
+
+// Workers for the data-parallel correlation search, one per core
+ThreadPool* g_threadPool = NULL;
+
 // Add global variable to track last used DAC sample count
 volatile int g_lastDacSampleCount = 65536;  // Default value
 
@@ -64,6 +171,80 @@ const char* ADC_DETAILED_CSV_FILE_PATH = "adc_detailed_data.csv";
 std::vector<std::complex<float>> g_filteredStartPilot;
 std::vector<std::complex<float>> g_filteredEndPilot;
 
+PilotDetector g_startDetector;
+PilotDetector g_endDetector;
+
+// The Q15 correlators are only used once they pass the conformance check
+bool g_fixedDetectorValid = false;
+
+// Pilot detector used by the receive command
+enum DetectorMode {
+    DETECTOR_FLOAT,     // FFT correlator on calibrated float samples
+    DETECTOR_FIXED      // Q15 correlator on raw ADC words
+};
+
+enum CaptureMode {
+    CAPTURE_FIXED,      // Up to one second of samples
+    CAPTURE_FRAME,      // Window sized from the last transmitted frame
+    CAPTURE_TRIGGER,    // Start pilot triggers; pre-trigger history plus a post-trigger length
+    CAPTURE_LEVEL       // ADC level trigger; one blocking acquisition of pre- plus post-trigger samples
+};
+
+// Receive-path settings, changed at runtime with "config key=value ..."
+struct RxConfig {
+    DetectorMode detector;
+    SearchMode search;
+    int decimation;             // Coarse-stage decimation factor
+    float coarseThreshold;      // Coarse score that makes a position a candidate
+    float energyGate;           // Minimum mean power (V^2) of a decimated window, 0 disables
+    float startThreshold;       // Full-rate detection thresholds
+    float endThreshold;
+    int captureLimitMB;         // Memory cap of the capture store
+    CaptureMode capture;
+    float captureGuard;         // Frame-sized window multiplier
+    bool captureExtend;         // Past the window, wait for the end pilot of a found start pilot
+    int preTrigger;             // Samples kept before the trigger in trigger mode
+    int postTrigger;            // Samples committed from the trigger on
+    int triggerChannel;         // Level trigger: ADC channel 1 (I) or 2 (Q)
+    float triggerLevel;         // Level in volts
+    TriggerEdge triggerEdge;
+    float rrcRolloff;           // Matched filter design
+    int rrcSpan;
+    int rrcSps;
+};
+
+RxConfig g_rxConfig = {
+    DETECTOR_FLOAT, SEARCH_EXHAUSTIVE,
+    COARSE_DEFAULT_DECIMATION, COARSE_DEFAULT_THRESHOLD, 0.0f,
+    PILOT_DETECT_THRESHOLD, PILOT_DETECT_THRESHOLD,
+    CAPTURE_DEFAULT_LIMIT_MB, CAPTURE_FRAME, CAPTURE_DEFAULT_GUARD, true,
+    TRIGGER_DEFAULT_PRETRIGGER, TRIGGER_DEFAULT_POSTTRIGGER,
+    1, TRIGGER_DEFAULT_LEVEL, TRIGGER_RISING,
+    RRC_DEFAULT_ROLLOFF, RRC_DEFAULT_SPAN, RRC_DEFAULT_SPS
+};
+
+// Matched filter taps, designed from g_rxConfig whenever the RRC settings change
+std::vector<float> g_matchedFilterTaps;
+
+// On-board processing requested with "receive [key=value ...]"
+struct ReceiveOptions {
+    bool matchedFilter;         // filter=rrc
+    int decimation;             // decimate=N, keep every Nth matched filter output
+    int resampleUp;             // resample=P/Q, applied before the matched filter
+    int resampleDown;
+    bool carrierCorrection;     // cfo=on, derotate by the pilot-aided carrier estimate
+    int demodOrder;             // demod=M, square M-QAM on the payload; 0 keeps the samples
+    bool replyBits;             // reply=bits, packed hard bits instead of symbol IQ
+    int maxFrames;              // frames=N, reply with up to N frames of one capture as a frame list
+    bool measure;               // "measure": reply with metrics against the reference only
+};
+
+// Transmitted payload uploaded with "reference bits|symbols", one value per byte,
+// so symbol references only cover orders up to 256
+std::vector<uint8_t> g_referenceValues;
+bool g_referenceIsBits = false;
+
+
 
 // Signal handler function
 void sig_handler(int signo) {
@@ -73,21 +254,6 @@ void sig_handler(int signo) {
     }
 }
 
-// Helper function: Receive exact number of bytes
-bool receiveExactBytes(int socket, void* buffer, size_t length) {
-    size_t totalReceived = 0;
-    char* buf = (char*)buffer;
-    
-    while (totalReceived < length) {
-        ssize_t received = recv(socket, buf + totalReceived, length - totalReceived, 0);
-        if (received <= 0) {
-            return false;
-        }
-        totalReceived += received;
-    }
-    return true;
-}
-
 
 void resetZmodHardware() {
     std::cout << "Resetting ZMOD hardware state..." << std::endl;
@@ -99,15 +265,11 @@ void resetZmodHardware() {
         usleep(50000); // 50ms延迟
         
         // 发送零信号清空DAC输出
-        size_t zeroLength = 1024;
-        uint32_t *zeroBuf = g_dacZmod->allocChannelsBuffer(zeroLength);
-        if (zeroBuf) {
-            memset(zeroBuf, 0, zeroLength * sizeof(uint32_t));
-            g_dacZmod->setData(zeroBuf, zeroLength);
+        if (g_dacZeroWave) {
+            g_dacZmod->setData(g_dacZeroWave.data(), DAC_ZERO_LENGTH);
             g_dacZmod->start();
-            usleep(10000); // 让零信号输出一段时间
+            usleep(DAC_ZERO_SETTLE_US); // 让零信号输出一段时间
             g_dacZmod->stop();
-            g_dacZmod->freeChannelsBuffer(zeroBuf, zeroLength);
         }
         
         // 重新设置DAC参数
@@ -125,12 +287,11 @@ void resetZmodHardware() {
         g_adcZmod->setGain(0, ADC_GAIN);
         g_adcZmod->setGain(1, ADC_GAIN);
         
-        // 执行一次小的采集操作来清空ADC缓存
+        // 执行一次小的采集操作来清空ADC缓存; this also drains a transfer left armed by a trigger timeout
         size_t clearSize = 100;
-        uint32_t *clearBuf = g_adcZmod->allocChannelsBuffer(clearSize);
-        if (clearBuf) {
-            g_adcZmod->acquireImmediatePolling(clearBuf, clearSize);
-            g_adcZmod->freeChannelsBuffer(clearBuf, clearSize);
+        DmaLease clearBuf = g_adcPool->lease(clearSize);
+        if (clearBuf && !ZmodAdcSource(g_adcZmod).acquire(clearBuf.data(), clearSize)) {
+            std::cout << "  WARNING: a timed-out trigger transfer is still armed" << std::endl;
         }
         std::cout << "  ADC reset complete" << std::endl;
     }
@@ -142,93 +303,70 @@ void resetZmodHardware() {
 
 
 
-// Function to receive filtered pilots from MATLAB
-bool receiveFilteredPilots(int client_fd) {
-
-    // Send acknowledgment
-    const char* reply = "Ready for filtered pilots";
-    if (send(client_fd, reply, strlen(reply), 0) < 0) {
-        perror("Send acknowledgment failed");
+/*
+ * Receive one filtered pilot: its length as int32, then all real parts and
+ * all imaginary parts, or I, Q pairs straight into the pilot when the session
+ * uses interleaved float32.
+ */
+bool receivePilot(ClientSession& session, const char* name, std::vector<std::complex<float>>& pilot) {
+    int32_t length;
+    if (!session.receive(&length, sizeof(int32_t))) {
+        std::cerr << "Failed to receive " << name << " pilot length" << std::endl;
         return false;
     }
-    
-    // Receive start pilot length
-    int32_t startPilotLength;
-    if (!receiveExactBytes(client_fd, &startPilotLength, sizeof(int32_t))) {
-        perror("Failed to receive start pilot length");
+    if (length < 0 || (size_t)length > PROTOCOL_MAX_DATA / sizeof(std::complex<float>)) {
+        std::cerr << "Invalid " << name << " pilot length " << length << std::endl;
         return false;
     }
     
-    std::cout << "Receiving filtered start pilot, length: " << startPilotLength << " samples" << std::endl;
-    
-    // Allocate memory for start pilot
-    float* startPilotReal = new float[startPilotLength];
-    float* startPilotImag = new float[startPilotLength];
-    
-    // Receive real part of start pilot
-    if (!receiveExactBytes(client_fd, startPilotReal, startPilotLength * sizeof(float))) {
-        perror("Failed to receive start pilot real part");
-        delete[] startPilotReal;
-        delete[] startPilotImag;
-        return false;
+    std::cout << "Receiving filtered " << name << " pilot, length: " << length << " samples" << std::endl;
+    pilot.resize(length);
+    if (session.sampleFormat() == SAMPLE_FORMAT_FLOAT32_INTERLEAVED) {
+        if (!session.receive(pilot.data(), length * sizeof(std::complex<float>))) {
+            std::cerr << "Failed to receive " << name << " pilot" << std::endl;
+            return false;
+        }
+        return true;
     }
     
-    // Receive imaginary part of start pilot
-    if (!receiveExactBytes(client_fd, startPilotImag, startPilotLength * sizeof(float))) {
-        perror("Failed to receive start pilot imaginary part");
-        delete[] startPilotReal;
-        delete[] startPilotImag;
+    // Both planar parts in one scattered read, then interleaved. The copy is kept on
+    // purpose: a strided read straight into the pilot needs one iovec per float, past
+    // IOV_MAX for any real pilot, and pilots only arrive once per setup.
+    std::vector<float> realPart(length);
+    std::vector<float> imagPart(length);
+    ReceiveSegment segments[] = {
+        { realPart.data(), length * sizeof(float) },
+        { imagPart.data(), length * sizeof(float) }
+    };
+    if (!session.receive(segments, 2)) {
+        std::cerr << "Failed to receive " << name << " pilot real and imaginary parts" << std::endl;
         return false;
     }
-    
-    // Store start pilot in global vector
-    g_filteredStartPilot.resize(startPilotLength);
-    for (int i = 0; i < startPilotLength; i++) {
-        g_filteredStartPilot[i] = std::complex<float>(startPilotReal[i], startPilotImag[i]);
-    }
-    
-    // Free temporary arrays
-    delete[] startPilotReal;
-    delete[] startPilotImag;
-    
-    // Receive end pilot length
-    int32_t endPilotLength;
-    if (!receiveExactBytes(client_fd, &endPilotLength, sizeof(int32_t))) {
-        perror("Failed to receive end pilot length");
-        return false;
+    for (int i = 0; i < length; i++) {
+        pilot[i] = std::complex<float>(realPart[i], imagPart[i]);
     }
-    
-    std::cout << "Receiving filtered end pilot, length: " << endPilotLength << " samples" << std::endl;
-    
-    // Allocate memory for end pilot
-    float* endPilotReal = new float[endPilotLength];
-    float* endPilotImag = new float[endPilotLength];
-    
-    // Receive real part of end pilot
-    if (!receiveExactBytes(client_fd, endPilotReal, endPilotLength * sizeof(float))) {
-        perror("Failed to receive end pilot real part");
-        delete[] endPilotReal;
-        delete[] endPilotImag;
+    return true;
+}
+
+// Function to receive filtered pilots from MATLAB
+bool receiveFilteredPilots(ClientSession& session) {
+
+    // Send acknowledgment
+    const char* reply = "Ready for filtered pilots";
+    if (!session.sendText(reply)) {
+        perror("Send acknowledgment failed");
         return false;
     }
     
-    // Receive imaginary part of end pilot
-    if (!receiveExactBytes(client_fd, endPilotImag, endPilotLength * sizeof(float))) {
-        perror("Failed to receive end pilot imaginary part");
-        delete[] endPilotReal;
-        delete[] endPilotImag;
+    // Only take the new pilots once both arrived, so the correlators keep matching the globals
+    std::vector<std::complex<float>> startPilot;
+    std::vector<std::complex<float>> endPilot;
+    if (!receivePilot(session, "start", startPilot) ||
+        !receivePilot(session, "end", endPilot)) {
         return false;
     }
-    
-    // Store end pilot in global vector
-    g_filteredEndPilot.resize(endPilotLength);
-    for (int i = 0; i < endPilotLength; i++) {
-        g_filteredEndPilot[i] = std::complex<float>(endPilotReal[i], endPilotImag[i]);
-    }
-    
-    // Free temporary arrays
-    delete[] endPilotReal;
-    delete[] endPilotImag;
+    g_filteredStartPilot.swap(startPilot);
+    g_filteredEndPilot.swap(endPilot);
     
     // Save pilots to files for debugging
     std::ofstream startPilotFile("filtered_start_pilot.csv");
@@ -253,24 +391,27 @@ bool receiveFilteredPilots(int client_fd) {
     }
     endPilotFile.close();
     
-    // Calculate pilot energies for later use
-    float startPilotEnergy = 0.0f;
-    float endPilotEnergy = 0.0f;
-    
-    for (const auto& sample : g_filteredStartPilot) {
-        startPilotEnergy += std::norm(sample);
-    }
+    // Cache the pilot spectra for the receive-side correlator
+    g_startDetector.correlator.setPilot(g_filteredStartPilot);
+    g_endDetector.correlator.setPilot(g_filteredEndPilot);
+    g_startDetector.coarseCorrelator.setPilot(g_filteredStartPilot, g_rxConfig.decimation);
+    g_endDetector.coarseCorrelator.setPilot(g_filteredEndPilot, g_rxConfig.decimation);
     
-    for (const auto& sample : g_filteredEndPilot) {
-        endPilotEnergy += std::norm(sample);
-    }
+    std::cout << "Filtered start pilot energy: " << g_startDetector.correlator.energy() << std::endl;
+    std::cout << "Filtered end pilot energy: " << g_endDetector.correlator.energy() << std::endl;
     
-    std::cout << "Filtered start pilot energy: " << startPilotEnergy << std::endl;
-    std::cout << "Filtered end pilot energy: " << endPilotEnergy << std::endl;
+    // Quantise the pilots for the fixed-point detector and check it against the float one
+    g_startDetector.fixedCorrelator.setPilot(g_filteredStartPilot, g_adcConverter->scale(), g_adcConverter->offset());
+    g_endDetector.fixedCorrelator.setPilot(g_filteredEndPilot, g_adcConverter->scale(), g_adcConverter->offset());
+    float startFixedError = fixedCorrelationError(g_startDetector.correlator, g_startDetector.fixedCorrelator);
+    float endFixedError = fixedCorrelationError(g_endDetector.correlator, g_endDetector.fixedCorrelator);
+    g_fixedDetectorValid = startFixedError <= FIXED_DETECTOR_TOLERANCE && endFixedError <= FIXED_DETECTOR_TOLERANCE;
+    std::cout << "Q15 detector max score error: start " << startFixedError << ", end " << endFixedError
+              << (g_fixedDetectorValid ? "" : " - disabled, float detector will be used") << std::endl;
     
     // Send acknowledgment
     const char* ack = "Pilots received successfully";
-    if (send(client_fd, ack, strlen(ack), 0) < 0) {
+    if (!session.sendText(ack)) {
         perror("Send final acknowledgment failed");
         return false;
     }
@@ -279,6 +420,50 @@ bool receiveFilteredPilots(int client_fd) {
     return true;
 }
 
+// Receive the transmitted payload for on-board measurements; args is "bits" or "symbols"
+bool receiveReference(ClientSession& session, const char* args) {
+    bool isBits = strcmp(args, "bits") == 0;
+    if (!isBits && strcmp(args, "symbols") != 0) {
+        const char* error_msg = "Error: reference must be bits or symbols";
+        session.sendError(error_msg);
+        return false;
+    }
+    
+    // Send acknowledgment
+    const char* reply = "Ready for reference";
+    if (!session.sendText(reply)) {
+        perror("Send acknowledgment failed");
+        return false;
+    }
+    
+    int32_t referenceLength;
+    if (!session.receive(&referenceLength, sizeof(int32_t))) {
+        perror("Failed to receive reference length");
+        return false;
+    }
+    if (referenceLength < 0 || (size_t)referenceLength > PROTOCOL_MAX_DATA) {
+        std::cerr << "Invalid reference length " << referenceLength << std::endl;
+        return false;
+    }
+    
+    std::vector<uint8_t> values(referenceLength);
+    if (!session.receive(values.data(), values.size())) {
+        perror("Failed to receive reference values");
+        return false;
+    }
+    g_referenceValues.swap(values);
+    g_referenceIsBits = isBits;
+    
+    std::cout << "Reference received: " << referenceLength << (isBits ? " bits" : " symbols") << std::endl;
+    
+    const char* ack = "Reference received successfully";
+    if (!session.sendText(ack)) {
+        perror("Send final acknowledgment failed");
+        return false;
+    }
+    return true;
+}
+
 
 // Save received signal data to CSV file
 bool saveSignalToCSV(float* realData, float* imagData, int numSamples, const char* filePath) {
@@ -301,53 +486,32 @@ bool saveSignalToCSV(float* realData, float* imagData, int numSamples, const cha
     return true;
 }
 
-// Generate DAC signal from complex data
-void dacGenerateFromComplex(float* realData, float* imagData, int numSamples) {
-    if (!g_dacZmod) {
-        std::cerr << "DAC not initialized!" << std::endl;
-        return;
-    }
-    
+// Output a waveform that is already packed in its DMA buffer; the buffer is returned once it is set up
+void dacOutputWaveform(DmaLease& lease, int numSamples) {
     // Update global sample count tracker
     g_lastDacSampleCount = numSamples;
     std::cout << "Updated g_lastDacSampleCount to " << g_lastDacSampleCount << std::endl;
     
-    // Allocate DAC channel buffer
+    uint32_t *buf = lease.data();
     size_t length = numSamples;
-    uint32_t *buf = g_dacZmod->allocChannelsBuffer(length);
-    if (!buf) {
-        std::cerr << "Failed to allocate DMA buffer!" << std::endl;
-        return;
-    }
-    
     
     g_dacZmod->setOutputSampleFrequencyDivider(0);
     g_dacZmod->setGain(0, DAC_GAIN);  // Channel 0 (real part)
     g_dacZmod->setGain(1, DAC_GAIN);  // Channel 1 (imaginary part)
-
     
-    // Prepare data for both channels
-    for (int i = 0; i < numSamples; i++) {
-        // Process real part (Channel 0)
-        int16_t realRaw = g_dacZmod->getSignedRawFromVolt(realData[i], DAC_GAIN);
-        
-        // Process imaginary part (Channel 1)
-        int16_t imagRaw = g_dacZmod->getSignedRawFromVolt(imagData[i], DAC_GAIN);
-        
-        // Combine both channels' data into a single 32-bit word
-        uint32_t realValBuf = g_dacZmod->arrangeChannelData(0, realRaw);
-        uint32_t imagValBuf = g_dacZmod->arrangeChannelData(1, imagRaw);
-        
-        // Combine both channel values
-        buf[i] = realValBuf | imagValBuf;
-        
-        // Print debug info for first/last few samples only
-        if (i < 5 || i > numSamples - 5) {
-            std::cout << "DAC Sample[" << i << "]: real=" << realData[i] 
-                      << ", imag=" << imagData[i]
-                      << ", real_raw=" << realRaw 
-                      << ", imag_raw=" << imagRaw << std::endl;
-        }
+    // Print debug info for first/last few samples only
+    auto printSample = [buf](int i) {
+        int16_t realRaw = (int32_t)buf[i] >> 18;
+        int16_t imagRaw = (int32_t)(buf[i] << 16) >> 18;
+        std::cout << "DAC Sample[" << i << "]: real_raw=" << realRaw 
+                  << ", imag_raw=" << imagRaw << std::endl;
+    };
+    const int head = std::min(numSamples, DAC_DEBUG_HEAD_SAMPLES);
+    for (int i = 0; i < head; i++) {
+        printSample(i);
+    }
+    for (int i = std::max(head, numSamples - DAC_DEBUG_TAIL_SAMPLES); i < numSamples; i++) {
+        printSample(i);
     }
     
     // Send data to DAC and start output
@@ -362,16 +526,887 @@ void dacGenerateFromComplex(float* realData, float* imagData, int numSamples) {
     int waitTimeUs = (int)(transmissionTimeMs * 1000) * 2; 
     usleep(waitTimeUs);
 
-    // Free the buffer after transmission is set up
-    g_dacZmod->freeChannelsBuffer(buf, length);
+    // Return the buffer after transmission is set up
+    lease.reset();
+}
+
+// Generate DAC signal from complex data
+void dacGenerateFromComplex(float* realData, float* imagData, int numSamples) {
+    if (!g_dacZmod) {
+        std::cerr << "DAC not initialized!" << std::endl;
+        return;
+    }
+    
+    // Lease a DAC channel buffer
+    DmaLease lease = g_dacPool->lease(numSamples);
+    if (!lease) {
+        std::cerr << "Failed to allocate DMA buffer!" << std::endl;
+        return;
+    }
+    
+    // Convert, saturate and pack both channels straight into the DMA buffer
+    g_dacPacker->pack(realData, imagData, numSamples, lease.data());
+    dacOutputWaveform(lease, numSamples);
     
     // Save data to CSV file for analysis
     saveSignalToCSV(realData, imagData, numSamples, DAC_CSV_FILE_PATH);
-    usleep(500000);
 }
 
+/*
+ * Receive an interleaved transmit upload straight into a DAC DMA buffer and output it.
+ * int16 codes are as wide as the DMA words and are packed in place; float32
+ * pairs are received and packed a chunk at a time.
+ */
+bool dacReceiveInterleaved(ClientSession& session, SampleFormat format, int numSamples) {
+    DmaLease lease = g_dacPool->lease(numSamples);
+    if (!lease) {
+        std::cerr << "Failed to allocate DMA buffer!" << std::endl;
+        return false;
+    }
+    uint32_t* buf = lease.data();
+    
+    if (format == SAMPLE_FORMAT_RICE14) {
+        // The coded length follows the sample count; codes are decoded in place of the words
+        int32_t codedLength = 0;
+        if (!session.receive(&codedLength, sizeof(codedLength))) {
+            return false;
+        }
+        if (codedLength < 0 || (uint32_t)codedLength > PROTOCOL_MAX_DATA) {
+            std::cerr << "Invalid coded upload length " << codedLength << std::endl;
+            return false;
+        }
+        std::vector<uint8_t> coded(codedLength);
+        if (!session.receive(coded.data(), coded.size())) {
+            return false;
+        }
+        if (!iqDecode(coded.data(), coded.size(), numSamples, reinterpret_cast<int16_t*>(buf))) {
+            std::cerr << "Corrupt coded upload" << std::endl;
+            return false;
+        }
+        g_dacPacker->packRaw(reinterpret_cast<int16_t*>(buf), numSamples, buf);
+    } else if (format == SAMPLE_FORMAT_PACKED14) {
+        // Whole chunks are an even number of pairs, so they start on a byte boundary
+        std::vector<uint8_t> chunk(packed14Length(CONVERT_CHUNK_LENGTH));
+        for (int chunkStart = 0; chunkStart < numSamples; chunkStart += CONVERT_CHUNK_LENGTH) {
+            int chunkLength = std::min(CONVERT_CHUNK_LENGTH, numSamples - chunkStart);
+            if (!session.receive(chunk.data(), packed14Length(chunkLength))) {
+                return false;
+            }
+            unpackWords14(chunk.data(), chunkLength, buf + chunkStart);
+        }
+    } else if (format == SAMPLE_FORMAT_INT16_INTERLEAVED) {
+        if (!session.receive(buf, (size_t)numSamples * sizeof(uint32_t))) {
+            return false;
+        }
+        g_dacPacker->packRaw(reinterpret_cast<int16_t*>(buf), numSamples, buf);
+    } else {
+        std::vector<float> chunk(2 * CONVERT_CHUNK_LENGTH);
+        for (int chunkStart = 0; chunkStart < numSamples; chunkStart += CONVERT_CHUNK_LENGTH) {
+            int chunkLength = std::min(CONVERT_CHUNK_LENGTH, numSamples - chunkStart);
+            if (!session.receive(chunk.data(), 2 * chunkLength * sizeof(float))) {
+                return false;
+            }
+            g_dacPacker->packInterleaved(chunk.data(), chunkLength, buf + chunkStart);
+        }
+    }
+    
+    // The CSV shows the volts of the packed codes
+    std::vector<float> realData(numSamples);
+    std::vector<float> imagData(numSamples);
+    for (int i = 0; i < numSamples; i++) {
+        realData[i] = ((int32_t)buf[i] >> 18) / g_dacPacker->codesPerVolt();
+        imagData[i] = ((int32_t)(buf[i] << 16) >> 18) / g_dacPacker->codesPerVolt();
+    }
+    dacOutputWaveform(lease, numSamples);
+    saveSignalToCSV(realData.data(), imagData.data(), numSamples, DAC_CSV_FILE_PATH);
+    return true;
+}
+
+
+// Parse a numeric setting that must lie in [minValue, maxValue]
+bool parseSetting(const char* value, float minValue, float maxValue, float& out) {
+    char* end = NULL;
+    float parsed = strtof(value, &end);
+    if (end == value || *end != '\0' || !(parsed >= minValue && parsed <= maxValue)) {
+        return false;
+    }
+    out = parsed;
+    return true;
+}
+
+bool parseSetting(const char* value, int minValue, int maxValue, int& out) {
+    char* end = NULL;
+    long parsed = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || parsed < minValue || parsed > maxValue) {
+        return false;
+    }
+    out = (int)parsed;
+    return true;
+}
+
+// Redesign the cached matched filter from the current settings
+void updateMatchedFilter() {
+    g_matchedFilterTaps = designRootRaisedCosine(g_rxConfig.rrcRolloff, g_rxConfig.rrcSpan, g_rxConfig.rrcSps);
+}
+
+// Apply one receive setting; returns false for an unknown key or value
+bool applyRxSetting(const char* key, const char* value) {
+    if (strcmp(key, "detector") == 0) {
+        if (strcmp(value, "float") == 0) {
+            g_rxConfig.detector = DETECTOR_FLOAT;
+            return true;
+        }
+        if (strcmp(value, "q15") == 0) {
+            g_rxConfig.detector = DETECTOR_FIXED;
+            return true;
+        }
+    }
+    else if (strcmp(key, "search") == 0) {
+        if (strcmp(value, "exhaustive") == 0) {
+            g_rxConfig.search = SEARCH_EXHAUSTIVE;
+            return true;
+        }
+        if (strcmp(value, "coarse") == 0) {
+            g_rxConfig.search = SEARCH_COARSE;
+            return true;
+        }
+    }
+    else if (strcmp(key, "decimation") == 0) {
+        if (!parseSetting(value, 1, COARSE_MAX_DECIMATION, g_rxConfig.decimation)) {
+            return false;
+        }
+        // The coarse correlators hold the pilots decimated by the old factor
+        g_startDetector.coarseCorrelator.setPilot(g_filteredStartPilot, g_rxConfig.decimation);
+        g_endDetector.coarseCorrelator.setPilot(g_filteredEndPilot, g_rxConfig.decimation);
+        return true;
+    }
+    else if (strcmp(key, "coarse_threshold") == 0) {
+        return parseSetting(value, 0.0f, 1.0f, g_rxConfig.coarseThreshold);
+    }
+    else if (strcmp(key, "energy_gate") == 0) {
+        return parseSetting(value, 0.0f, 1e6f, g_rxConfig.energyGate);
+    }
+    else if (strcmp(key, "start_threshold") == 0) {
+        return parseSetting(value, 0.0f, 1.0f, g_rxConfig.startThreshold);
+    }
+    else if (strcmp(key, "end_threshold") == 0) {
+        return parseSetting(value, 0.0f, 1.0f, g_rxConfig.endThreshold);
+    }
+    else if (strcmp(key, "capture_mb") == 0) {
+        return parseSetting(value, 1, CAPTURE_MAX_LIMIT_MB, g_rxConfig.captureLimitMB);
+    }
+    else if (strcmp(key, "capture") == 0) {
+        if (strcmp(value, "fixed") == 0) {
+            g_rxConfig.capture = CAPTURE_FIXED;
+            return true;
+        }
+        if (strcmp(value, "frame") == 0) {
+            g_rxConfig.capture = CAPTURE_FRAME;
+            return true;
+        }
+        if (strcmp(value, "trigger") == 0) {
+            g_rxConfig.capture = CAPTURE_TRIGGER;
+            return true;
+        }
+        if (strcmp(value, "level") == 0) {
+            g_rxConfig.capture = CAPTURE_LEVEL;
+            return true;
+        }
+    }
+    else if (strcmp(key, "pretrigger") == 0) {
+        return parseSetting(value, 0, TRIGGER_MAX_LENGTH, g_rxConfig.preTrigger);
+    }
+    else if (strcmp(key, "posttrigger") == 0) {
+        return parseSetting(value, 1, TRIGGER_MAX_LENGTH, g_rxConfig.postTrigger);
+    }
+    else if (strcmp(key, "trigger_channel") == 0) {
+        return parseSetting(value, 1, 2, g_rxConfig.triggerChannel);
+    }
+    else if (strcmp(key, "trigger_level") == 0) {
+        return parseSetting(value, -TRIGGER_MAX_LEVEL, TRIGGER_MAX_LEVEL, g_rxConfig.triggerLevel);
+    }
+    else if (strcmp(key, "trigger_edge") == 0) {
+        if (strcmp(value, "rising") == 0) {
+            g_rxConfig.triggerEdge = TRIGGER_RISING;
+            return true;
+        }
+        if (strcmp(value, "falling") == 0) {
+            g_rxConfig.triggerEdge = TRIGGER_FALLING;
+            return true;
+        }
+    }
+    else if (strcmp(key, "capture_guard") == 0) {
+        return parseSetting(value, 1.0f, CAPTURE_MAX_GUARD, g_rxConfig.captureGuard);
+    }
+    else if (strcmp(key, "capture_extend") == 0) {
+        if (strcmp(value, "on") == 0 || strcmp(value, "off") == 0) {
+            g_rxConfig.captureExtend = strcmp(value, "on") == 0;
+            return true;
+        }
+    }
+    else if (strcmp(key, "rrc_rolloff") == 0) {
+        if (!parseSetting(value, 0.0f, 1.0f, g_rxConfig.rrcRolloff)) {
+            return false;
+        }
+        updateMatchedFilter();
+        return true;
+    }
+    // Like rcosdesign, span * sps must be even so the filter has a centre tap
+    else if (strcmp(key, "rrc_span") == 0) {
+        int span;
+        if (!parseSetting(value, 1, RRC_MAX_SPAN, span) || span * g_rxConfig.rrcSps % 2 != 0) {
+            return false;
+        }
+        g_rxConfig.rrcSpan = span;
+        updateMatchedFilter();
+        return true;
+    }
+    else if (strcmp(key, "rrc_sps") == 0) {
+        int sps;
+        if (!parseSetting(value, 1, RRC_MAX_SPS, sps) || g_rxConfig.rrcSpan * sps % 2 != 0) {
+            return false;
+        }
+        g_rxConfig.rrcSps = sps;
+        updateMatchedFilter();
+        return true;
+    }
+    return false;
+}
+
+const char* captureModeName(CaptureMode mode) {
+    switch (mode) {
+    case CAPTURE_FIXED:
+        return "fixed";
+    case CAPTURE_TRIGGER:
+        return "trigger";
+    case CAPTURE_LEVEL:
+        return "level";
+    default:
+        return "frame";
+    }
+}
+
+// Current settings as "key=value ..." in the syntax the config command accepts
+void formatRxConfig(char* text, size_t size) {
+    snprintf(text, size,
+             "detector=%s search=%s decimation=%d coarse_threshold=%g energy_gate=%g "
+             "start_threshold=%g end_threshold=%g capture_mb=%d capture=%s capture_guard=%g capture_extend=%s "
+             "pretrigger=%d posttrigger=%d trigger_channel=%d trigger_level=%g trigger_edge=%s "
+             "rrc_rolloff=%g rrc_span=%d rrc_sps=%d",
+             g_rxConfig.detector == DETECTOR_FIXED ? "q15" : "float",
+             g_rxConfig.search == SEARCH_COARSE ? "coarse" : "exhaustive",
+             g_rxConfig.decimation, g_rxConfig.coarseThreshold, g_rxConfig.energyGate,
+             g_rxConfig.startThreshold, g_rxConfig.endThreshold, g_rxConfig.captureLimitMB,
+             captureModeName(g_rxConfig.capture),
+             g_rxConfig.captureGuard, g_rxConfig.captureExtend ? "on" : "off",
+             g_rxConfig.preTrigger, g_rxConfig.postTrigger,
+             g_rxConfig.triggerChannel, g_rxConfig.triggerLevel,
+             g_rxConfig.triggerEdge == TRIGGER_FALLING ? "falling" : "rising",
+             g_rxConfig.rrcRolloff, g_rxConfig.rrcSpan, g_rxConfig.rrcSps);
+}
+
+// Handle "config key=value ..." and reply with the resulting settings
+bool handleConfigCommand(ClientSession& session, char* args) {
+    bool valid = true;
+    char* save = NULL;
+    for (char* token = strtok_r(args, " \r\n", &save); token; token = strtok_r(NULL, " \r\n", &save)) {
+        char* separator = strchr(token, '=');
+        if (separator) {
+            *separator = '\0';
+        }
+        if (!separator || !applyRxSetting(token, separator + 1)) {
+            std::cerr << "Invalid config setting: " << token << std::endl;
+            valid = false;
+        }
+    }
+    
+    char settings[512];
+    formatRxConfig(settings, sizeof(settings));
+    char reply[640];
+    snprintf(reply, sizeof(reply), "%s %s", valid ? "OK" : "Error: invalid setting;", settings);
+    std::cout << "Receive config: " << reply << std::endl;
+    if (!(valid ? session.sendText(reply) : session.sendError(reply))) {
+        perror("Send config reply failed");
+        return false;
+    }
+    return valid;
+}
+
+// Handle "format planar|float32|int16|packed14|rice": the sample layout of this session's uploads and replies
+bool handleFormatCommand(ClientSession& session, char* args) {
+    char* save = NULL;
+    const char* name = strtok_r(args, " \r\n", &save);
+    SampleFormat format = SAMPLE_FORMAT_NONE;
+    if (!name) {
+        // Falls through to the error below
+    } else if (strcmp(name, "planar") == 0) {
+        format = SAMPLE_FORMAT_FLOAT32_PLANAR;
+    } else if (strcmp(name, "float32") == 0) {
+        format = SAMPLE_FORMAT_FLOAT32_INTERLEAVED;
+    } else if (strcmp(name, "int16") == 0) {
+        format = SAMPLE_FORMAT_INT16_INTERLEAVED;
+    } else if (strcmp(name, "packed14") == 0) {
+        format = SAMPLE_FORMAT_PACKED14;
+    } else if (strcmp(name, "rice") == 0) {
+        format = SAMPLE_FORMAT_RICE14;
+    }
+    if (format == SAMPLE_FORMAT_NONE) {
+        const char* error_msg = "Error: format must be planar, float32, int16, packed14 or rice";
+        session.sendError(error_msg);
+        return false;
+    }
+    session.setSampleFormat(format);
+    
+    // Clients of the code formats scale ADC codes with the reply calibration and DAC codes with codes per volt
+    char reply[160];
+    snprintf(reply, sizeof(reply), "OK format=%s adc_scale=%g adc_offset=%g dac_codes_per_volt=%g",
+             name, g_adcConverter->scale(), g_adcConverter->offset(), g_dacPacker->codesPerVolt());
+    std::cout << "Sample format: " << reply << std::endl;
+    if (!session.sendText(reply)) {
+        perror("Send format reply failed");
+        return false;
+    }
+    return true;
+}
+
+// Pilot search settings and workers of the receive path
+PilotSearchContext searchContext() {
+    PilotSearchContext context = { g_adcConverter, g_threadPool, g_rxConfig.coarseThreshold, g_rxConfig.energyGate };
+    return context;
+}
+
+// Parse the options of "receive [key=value ...]"; returns false for anything unknown
+bool parseReceiveOptions(char* args, ReceiveOptions& options) {
+    options.matchedFilter = false;
+    options.decimation = 1;
+    options.resampleUp = 1;
+    options.resampleDown = 1;
+    options.carrierCorrection = false;
+    options.demodOrder = 0;
+    options.replyBits = false;
+    options.maxFrames = 1;
+    options.measure = false;
+    
+    bool valid = true;
+    char* save = NULL;
+    for (char* token = strtok_r(args, " \r\n", &save); token; token = strtok_r(NULL, " \r\n", &save)) {
+        char* separator = strchr(token, '=');
+        if (!separator) {
+            valid = false;
+            continue;
+        }
+        *separator = '\0';
+        const char* value = separator + 1;
+        if (strcmp(token, "filter") == 0 && strcmp(value, "rrc") == 0) {
+            options.matchedFilter = true;
+        } else if (strcmp(token, "filter") == 0 && strcmp(value, "none") == 0) {
+            options.matchedFilter = false;
+        } else if (strcmp(token, "resample") == 0) {
+            if (sscanf(value, "%d/%d", &options.resampleUp, &options.resampleDown) != 2 ||
+                options.resampleUp < 1 || options.resampleUp > RESAMPLE_MAX_FACTOR ||
+                options.resampleDown < 1 || options.resampleDown > RESAMPLE_MAX_FACTOR) {
+                std::cerr << "Invalid receive option: resample=" << value << std::endl;
+                valid = false;
+            }
+        } else if (strcmp(token, "demod") == 0) {
+            if (!parseSetting(value, 4, 1 << 16, options.demodOrder) || !QamDemodulator::supported(options.demodOrder)) {
+                std::cerr << "Unsupported QAM order: " << value << std::endl;
+                valid = false;
+            }
+        } else if (strcmp(token, "cfo") == 0 && (strcmp(value, "on") == 0 || strcmp(value, "off") == 0)) {
+            options.carrierCorrection = strcmp(value, "on") == 0;
+        } else if (strcmp(token, "reply") == 0 && (strcmp(value, "symbols") == 0 || strcmp(value, "bits") == 0)) {
+            options.replyBits = strcmp(value, "bits") == 0;
+        } else if (strcmp(token, "frames") == 0) {
+            if (!parseSetting(value, 1, MAX_RECEIVE_FRAMES, options.maxFrames)) {
+                std::cerr << "Invalid frame count: " << value << std::endl;
+                valid = false;
+            }
+        } else if (strcmp(token, "decimate") != 0 || !parseSetting(value, 1, RRC_MAX_SPS, options.decimation)) {
+            std::cerr << "Invalid receive option: " << token << "=" << value << std::endl;
+            valid = false;
+        }
+    }
+    
+    // The matched filter is also the anti-alias filter of the decimator
+    if (options.decimation > 1 && !options.matchedFilter) {
+        std::cerr << "Receive decimation needs filter=rrc" << std::endl;
+        valid = false;
+    }
+    if (options.replyBits && options.demodOrder == 0) {
+        std::cerr << "reply=bits needs demod=M" << std::endl;
+        valid = false;
+    }
+    if (options.replyBits && options.maxFrames > 1) {
+        std::cerr << "reply=bits returns a single frame" << std::endl;
+        valid = false;
+    }
+    // rrc_sps counts samples per symbol at the DAC rate, so the 105 MHz capture must be
+    // resampled to 100 MHz before the matched filter and the symbol timing see it
+    if (options.demodOrder != 0 &&
+        options.resampleUp * ADC_TO_DAC_DOWN != options.resampleDown * ADC_TO_DAC_UP) {
+        std::cerr << "demod=M needs resample=" << ADC_TO_DAC_UP << "/" << ADC_TO_DAC_DOWN
+                  << " to bring the ADC rate to the DAC rate" << std::endl;
+        valid = false;
+    }
+    // Symbol timing is recovered on whole symbols of the decimated frame
+    if (options.demodOrder != 0 && g_rxConfig.rrcSps % options.decimation != 0) {
+        std::cerr << "Decimation " << options.decimation << " does not divide rrc_sps " << g_rxConfig.rrcSps << std::endl;
+        valid = false;
+    }
+    return valid;
+}
+
+// Calibrate the extracted words into a frame, derotating with the NCO if one is
+// given. With a rate change the words are converted chunk by chunk straight into
+// the streaming resampler, so the full-rate frame is never held in memory.
+void convertReceiveFrame(const ReceiveOptions& options, const uint32_t* words, size_t count, Nco* nco,
+                         std::vector<std::complex<float>>& frame) {
+    if (options.resampleUp == options.resampleDown) {
+        frame.resize(count);
+        g_adcConverter->convertComplex(words, count, frame.data());
+        if (nco) {
+            nco->derotate(frame.data(), count);
+        }
+        return;
+    }
+    
+    RationalResampler resampler(options.resampleUp, options.resampleDown);
+    std::vector<std::complex<float>> chunk(CONVERT_CHUNK_LENGTH);
+    frame.clear();
+    frame.reserve(resampler.outputLength(count));
+    
+    double started = monotonicSeconds();
+    for (size_t chunkStart = 0; chunkStart < count; chunkStart += CONVERT_CHUNK_LENGTH) {
+        size_t chunkLength = std::min((size_t)CONVERT_CHUNK_LENGTH, count - chunkStart);
+        g_adcConverter->convertComplex(words + chunkStart, chunkLength, chunk.data());
+        if (nco) {
+            nco->derotate(chunk.data(), chunkLength);
+        }
+        resampler.process(chunk.data(), chunkLength, frame);
+    }
+    resampler.flush(frame);
+    double elapsed = monotonicSeconds() - started;
+    std::cout << "Resampler " << resampler.interpolation() << "/" << resampler.decimation() << ": "
+              << count << " -> " << frame.size() << " samples (" << resampler.length() << " taps) in "
+              << elapsed * 1e3 << " ms" << std::endl;
+}
+
+// Run the on-board stages requested for this receive over the extracted frame
+void applyReceiveStages(const ReceiveOptions& options, std::vector<std::complex<float>>& frame) {
+    if (options.matchedFilter) {
+        FirDecimator matchedFilter(g_matchedFilterTaps, options.decimation);
+        std::vector<std::complex<float>> filtered;
+        double started = monotonicSeconds();
+        matchedFilter.filterAligned(frame.data(), frame.size(), filtered);
+        double elapsed = monotonicSeconds() - started;
+        std::cout << "Matched filter: " << frame.size() << " -> " << filtered.size() << " samples ("
+                  << matchedFilter.length() << " taps, decimation " << options.decimation << ") in "
+                  << elapsed * 1e3 << " ms" << std::endl;
+        frame.swap(filtered);
+    }
+}
+
+/*
+ * Replace the frame with the QAM symbols of its payload.
+ * @param inputLength - Capture samples the frame was produced from
+ * @param payloadStart - First payload sample, in capture samples from the frame start
+ * @param payloadEnd - One past the last payload sample, in capture samples
+ * @param values - Receives the sliced symbol values
+ */
+void demodulatePayload(const ReceiveOptions& options, std::vector<std::complex<float>>& frame, size_t inputLength,
+                       size_t payloadStart, size_t payloadEnd, std::vector<int>& values) {
+    // The rate stages scale capture positions by frame.size() / inputLength
+    const size_t first = inputLength ? (size_t)((uint64_t)payloadStart * frame.size() / inputLength) : 0;
+    const size_t last = inputLength ? (size_t)((uint64_t)payloadEnd * frame.size() / inputLength) : 0;
+    const size_t sps = g_rxConfig.rrcSps / options.decimation;
+    
+    QamDemodulator demodulator(options.demodOrder);
+    std::vector<std::complex<float>> symbols;
+    size_t phase = recoverSymbols(frame.data() + first, last > first ? last - first : 0, sps, symbols);
+    
+    values.resize(symbols.size());
+    double errorPower = 0.0;
+    for (size_t n = 0; n < symbols.size(); n++) {
+        values[n] = demodulator.slice(symbols[n]);
+        errorPower += std::norm(symbols[n] - demodulator.symbol(values[n]));
+    }
+    
+    std::cout << "Demodulator: " << options.demodOrder << "-QAM, " << symbols.size() << " symbols from samples "
+              << first << ".." << last << " at " << sps << " sps, timing phase " << phase;
+    if (!symbols.empty()) {
+        std::cout << ", decision EVM " << 100.0 * std::sqrt(errorPower / symbols.size()) << "%";
+    }
+    std::cout << std::endl;
+    frame.swap(symbols);
+}
+
+// Reset the kernel's peak resident set size (VmHWM) to the current RSS
+void resetPeakRss() {
+    FILE* file = fopen("/proc/self/clear_refs", "w");
+    if (file) {
+        fputs("5", file);
+        fclose(file);
+    }
+}
+
+// Peak resident set size in kB since the last reset, or -1 if unavailable
+long readPeakRssKb() {
+    FILE* file = fopen("/proc/self/status", "r");
+    if (!file) {
+        return -1;
+    }
+    char line[128];
+    long peak = -1;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "VmHWM: %ld kB", &peak) == 1) {
+            break;
+        }
+    }
+    fclose(file);
+    return peak;
+}
+
+// Detection state of one receive command
+struct PilotSearch {
+    bool startFound;
+    bool endFound;
+    int64_t startPosition;      // Stream positions, -1 until found
+    int64_t endPosition;
+    float startScore;
+    float endScore;
+};
+
+// Metrics of one demodulated frame against the uploaded reference
+LinkMetrics measureAgainstReference(const std::vector<std::complex<float>>& symbols,
+                                    const std::vector<int>& values, int order) {
+    QamDemodulator demodulator(order);
+    std::vector<int> reference;
+    if (g_referenceIsBits) {
+        reference = groupSymbolBits(g_referenceValues, demodulator.bitsPerSymbol());
+    } else {
+        reference.assign(g_referenceValues.begin(), g_referenceValues.end());
+    }
+    return measureLink(demodulator, symbols, values, reference);
+}
+
+// Reply to "measure": one METRICS record over all measured frames
+bool sendLinkMetrics(ClientSession& session, const LinkMetrics& metrics, size_t frames) {
+    char record[256];
+    snprintf(record, sizeof(record),
+             "METRICS frames=%zu symbols=%zu bits=%zu errors=%zu ber=%.6e evm=%.3f%% snr=%.2fdB",
+             frames, metrics.symbols, metrics.bits, metrics.bitErrors,
+             metrics.bits ? (double)metrics.bitErrors / metrics.bits : 0.0,
+             metrics.evm * 100.0, metrics.snrDb);
+    std::cout << record << std::endl;
+    
+    if (!session.sendText(record)) {
+        perror("Failed to send metrics");
+        return false;
+    }
+    return true;
+}
+
+// Reply to a "receive ... reply=bits": BITS=<count>, then the packed hard decisions
+bool sendPackedBits(ClientSession& session, const std::vector<int>& values, int order) {
+    QamDemodulator demodulator(order);
+    std::vector<uint8_t> bytes;
+    packSymbolBits(values, demodulator.bitsPerSymbol(), bytes);
+    
+    char bitCountStr[32];
+    sprintf(bitCountStr, "BITS=%zu", values.size() * demodulator.bitsPerSymbol());
+    std::cout << "Sending " << bitCountStr << ", " << bytes.size() << " bytes of packed bits to MATLAB..." << std::endl;
+    DataSegment segment = { bytes.data(), bytes.size() };
+    if (!session.sendData(bitCountStr, &segment, 1, SAMPLE_FORMAT_NONE)) {
+        perror("Send bit data failed");
+        return false;
+    }
+    return true;
+}
 
-bool handleReceiveCommand(int client_fd) {
+/*
+ * Run the on-board chain over one extracted frame: carrier correction, conversion,
+ * the rate and filter stages, and demodulation.
+ * @param dataStart - Stream position of the first frame sample
+ * @param dataLength - Frame length in capture samples
+ * @param leadingPilot - Start pilot samples at the frame start, 0 if the frame has none
+ * @param trailingPilot - End pilot samples at the frame end, 0 if the frame has none
+ * @param frame - Receives the processed samples, or the symbols when demodulating
+ * @param symbolValues - Receives the hard decisions when demodulating
+ */
+void processReceiveFrame(const ReceiveOptions& options, const CaptureStore<uint32_t>& wordStore,
+                         uint64_t dataStart, int dataLength, int leadingPilot, int trailingPilot,
+                         std::vector<std::complex<float>>& frame, std::vector<int>& symbolValues) {
+    // Pilot-aided carrier offset and phase, referenced to the first extracted sample
+    std::unique_ptr<Nco> nco;
+    if (options.carrierCorrection && leadingPilot > 0) {
+        std::vector<std::complex<float>> startWindow(leadingPilot);
+        std::vector<std::complex<float>> endWindow(trailingPilot);
+        g_adcConverter->convertComplex(wordStore.at(dataStart), leadingPilot, startWindow.data());
+        if (trailingPilot > 0) {
+            g_adcConverter->convertComplex(wordStore.at(dataStart + dataLength - trailingPilot), trailingPilot, endWindow.data());
+        }
+        CarrierEstimate carrier = estimateCarrier(startWindow.data(), g_filteredStartPilot,
+                                                  trailingPilot > 0 ? endWindow.data() : NULL, g_filteredEndPilot,
+                                                  dataLength - trailingPilot);
+        if (carrier.valid) {
+            std::cout << "Carrier offset: " << carrier.frequency * ADC_SAMPLES_PER_SECOND / (2.0 * M_PI) << " Hz ("
+                      << carrier.frequency << " rad/sample), phase " << carrier.phase << " rad, from "
+                      << (carrier.bothPilots ? "both pilots" : "the start pilot only") << std::endl;
+            nco.reset(new Nco(carrier.frequency, carrier.phase));
+        }
+    }
+    else if (options.carrierCorrection) {
+        std::cout << "WARNING: No start pilot in the frame, carrier correction skipped.\n";
+    }
+    
+    // Calibrate only the extracted range, then run the requested on-board stages
+    double derotateStarted = monotonicSeconds();
+    convertReceiveFrame(options, wordStore.at(dataStart), dataLength, nco.get(), frame);
+    if (nco) {
+        std::cout << "Converted and derotated " << dataLength << " samples in "
+                  << (monotonicSeconds() - derotateStarted) * 1e3 << " ms" << std::endl;
+    }
+    applyReceiveStages(options, frame);
+    symbolValues.clear();
+    if (options.demodOrder != 0) {
+        demodulatePayload(options, frame, dataLength, std::min(leadingPilot, dataLength),
+                          std::max(dataLength - trailingPilot, 0), symbolValues);
+    }
+}
+
+// Extent of one detected frame in the capture, both pilots included
+struct FrameSpan {
+    uint64_t start;             // Stream position
+    int length;
+};
+
+/*
+ * First stream position at which an end pilot is accepted after a start pilot:
+ * past the whole start pilot and more than minDataLength samples on. Both the
+ * single-frame search and findFrames() apply it.
+ * @param start - Stream position of the start pilot
+ * @param minDataLength - Smallest start-to-end pilot distance accepted as a frame
+ */
+uint64_t frameEndFrom(uint64_t start, int minDataLength) {
+    return start + std::max<uint64_t>(g_filteredStartPilot.size(), minDataLength + 1);
+}
+
+// First stream position in [from, to) where the pilot score crosses the threshold, or -1
+int64_t findPilotCrossing(const PilotDetector& detector, bool useFixed, float threshold,
+                          const CaptureStore<uint32_t>& wordStore, uint64_t from, uint64_t to) {
+    std::vector<float> score;
+    std::vector<float> magnitude;
+    for (uint64_t chunkStart = from; chunkStart < to; chunkStart += FRAME_SCAN_CHUNK_LENGTH) {
+        size_t count = (size_t)std::min<uint64_t>(FRAME_SCAN_CHUNK_LENGTH, to - chunkStart);
+        score.assign(count, 0.0f);
+        magnitude.assign(count, 0.0f);
+        searchPilot(searchContext(), detector, useFixed, g_rxConfig.search, wordStore.at(chunkStart), count,
+                    score.data(), magnitude.data());
+        for (size_t k = 0; k < count; k++) {
+            if (score[k] > threshold) {
+                return (int64_t)(chunkStart + k);
+            }
+        }
+    }
+    return -1;
+}
+
+/*
+ * Find consecutive, non-overlapping start/end pilot pairs in the retained capture,
+ * with the same first-crossing rule as the batch search.
+ * @param from - Stream position to start scanning at
+ * @param maxFrames - Stop after this many frames
+ * @param minDataLength - Smallest start-to-end pilot distance accepted as a frame
+ */
+std::vector<FrameSpan> findFrames(const CaptureStore<uint32_t>& wordStore, uint64_t from, bool useFixed,
+                                  int maxFrames, int minDataLength) {
+    const uint64_t startPilotLength = g_filteredStartPilot.size();
+    const uint64_t endPilotLength = g_filteredEndPilot.size();
+    // Last positions with a whole pilot window stored
+    const uint64_t startLimit = wordStore.end() >= startPilotLength ? wordStore.end() - startPilotLength + 1 : 0;
+    const uint64_t endLimit = wordStore.end() >= endPilotLength ? wordStore.end() - endPilotLength + 1 : 0;
+    
+    std::vector<FrameSpan> frames;
+    uint64_t cursor = std::max(from, wordStore.begin());
+    while ((int)frames.size() < maxFrames && cursor < startLimit) {
+        int64_t start = findPilotCrossing(g_startDetector, useFixed, g_rxConfig.startThreshold,
+                                          wordStore, cursor, startLimit);
+        if (start < 0) {
+            break;
+        }
+        uint64_t endFrom = frameEndFrom(start, minDataLength);
+        int64_t end = endFrom < endLimit ? findPilotCrossing(g_endDetector, useFixed, g_rxConfig.endThreshold,
+                                                             wordStore, endFrom, endLimit) : -1;
+        if (end < 0) {
+            break;
+        }
+        FrameSpan span = { (uint64_t)start, (int)(end + endPilotLength - start) };
+        frames.push_back(span);
+        cursor = end + endPilotLength;
+    }
+    return frames;
+}
+
+/*
+ * Reply with a header line, an optional binary prefix and then samples in the
+ * session's wire format.
+ * @param words - Capture words the samples were converted from without any
+ *                on-board stage, or NULL; codes are then taken straight from them
+ */
+bool sendSamples(ClientSession& session, const char* header, const DataSegment& prefix,
+                 const std::vector<std::complex<float>>& samples, const uint32_t* words) {
+    const SampleFormat format = session.sampleFormat();
+    const size_t count = samples.size();
+    
+    if (format == SAMPLE_FORMAT_FLOAT32_INTERLEAVED) {
+        // std::complex<float> already is an I, Q float pair
+        DataSegment segments[] = { prefix, { samples.data(), count * sizeof(std::complex<float>) } };
+        return session.sendData(header, segments, 2, format);
+    }
+    
+    if (format == SAMPLE_FORMAT_INT16_INTERLEAVED || format == SAMPLE_FORMAT_PACKED14 ||
+        format == SAMPLE_FORMAT_RICE14) {
+        SampleCalibration calibration = { g_adcConverter->scale(), g_adcConverter->offset() };
+        std::vector<int16_t> codes;
+        std::vector<uint8_t> bytes;
+        if (!words) {
+            // Filtered samples can exceed the code range; widen the step until they fit
+            const float codeMax = (format == SAMPLE_FORMAT_INT16_INTERLEAVED) ? INT16_MAX : PACKED14_CODE_MAX;
+            float peak = 0.0f;
+            for (const auto& sample : samples) {
+                peak = std::max(peak, std::max(std::fabs(sample.real() - calibration.offset),
+                                               std::fabs(sample.imag() - calibration.offset)));
+            }
+            calibration.scale = std::max(calibration.scale, peak / codeMax);
+            const float codesPerVolt = 1.0f / calibration.scale;
+            codes.resize(2 * count);
+            for (size_t n = 0; n < count; n++) {
+                codes[2 * n] = (int16_t)std::max(-codeMax, std::min(codeMax,
+                    std::round((samples[n].real() - calibration.offset) * codesPerVolt)));
+                codes[2 * n + 1] = (int16_t)std::max(-codeMax, std::min(codeMax,
+                    std::round((samples[n].imag() - calibration.offset) * codesPerVolt)));
+            }
+        }
+        
+        DataSegment payload;
+        std::string text = header;
+        if (format == SAMPLE_FORMAT_RICE14) {
+            // Coded length, ratio against int16 codes and encoder speed for the client
+            double started = monotonicSeconds();
+            if (words) {
+                iqEncodeWords(words, count, bytes);
+            } else {
+                iqEncodeCodes(codes.data(), count, bytes);
+            }
+            double elapsed = monotonicSeconds() - started;
+            const double rawBytes = count * 2.0 * sizeof(int16_t);
+            char codecInfo[128];
+            snprintf(codecInfo, sizeof(codecInfo), " BYTES=%zu RATIO=%.2f MBPS=%.1f", bytes.size(),
+                     bytes.empty() ? 1.0 : rawBytes / bytes.size(), elapsed > 0.0 ? rawBytes / elapsed / 1e6 : 0.0);
+            text += codecInfo;
+            std::cout << "Sample codec:" << codecInfo << std::endl;
+            payload = { bytes.data(), bytes.size() };
+        } else if (format == SAMPLE_FORMAT_PACKED14) {
+            // Raw captures go from DMA words to the wire without a code buffer
+            bytes.resize(packed14Length(count));
+            if (words) {
+                packWords14(words, count, bytes.data());
+            } else {
+                packCodes14(codes.data(), count, bytes.data());
+            }
+            payload = { bytes.data(), bytes.size() };
+        } else {
+            if (words) {
+                codes.resize(2 * count);
+                g_adcConverter->unpackRaw(words, count, codes.data());
+            }
+            payload = { codes.data(), codes.size() * sizeof(int16_t) };
+        }
+        DataSegment segments[] = { prefix, { &calibration, sizeof(calibration) }, payload };
+        return session.sendData(text.c_str(), segments, 3, format);
+    }
+    
+    std::vector<float> realPart(count);
+    std::vector<float> imagPart(count);
+    for (size_t n = 0; n < count; n++) {
+        realPart[n] = samples[n].real();
+        imagPart[n] = samples[n].imag();
+    }
+    DataSegment segments[] = {
+        prefix,
+        { realPart.data(), count * sizeof(float) },
+        { imagPart.data(), count * sizeof(float) }
+    };
+    return session.sendData(header, segments, 3, SAMPLE_FORMAT_FLOAT32_PLANAR);
+}
+
+// Reply to a multi-frame receive: FRAMES=<n> SAMPLES=<total>, then n int32 (offset, length)
+// pairs with offsets in capture samples from the first frame, then the samples of all frames in the session format
+bool sendFrameList(ClientSession& session, const std::vector<FrameSpan>& spans,
+                   const std::vector<std::vector<std::complex<float>>>& frames) {
+    std::vector<int32_t> table;
+    size_t totalSamples = 0;
+    for (size_t i = 0; i < spans.size(); i++) {
+        table.push_back((int32_t)(spans[i].start - spans[0].start));
+        table.push_back((int32_t)frames[i].size());
+        totalSamples += frames[i].size();
+    }
+    std::vector<std::complex<float>> samples;
+    samples.reserve(totalSamples);
+    for (const auto& frame : frames) {
+        samples.insert(samples.end(), frame.begin(), frame.end());
+    }
+    
+    char header[64];
+    sprintf(header, "FRAMES=%zu SAMPLES=%zu", spans.size(), totalSamples);
+    std::cout << "Sending frame list: " << header << std::endl;
+    DataSegment tableSegment = { table.data(), table.size() * sizeof(int32_t) };
+    if (!sendSamples(session, header, tableSegment, samples, NULL)) {
+        perror("Send frame list failed");
+        return false;
+    }
+    return true;
+}
+
+// Process every frame found after the first start pilot and reply with a frame list or combined metrics
+bool replyMultipleFrames(ClientSession& session, const ReceiveOptions& options, const CaptureStore<uint32_t>& wordStore,
+                         const PilotSearch& search, bool useFixed, int minDataLength) {
+    std::vector<FrameSpan> spans;
+    if (search.startFound) {
+        spans = findFrames(wordStore, search.startPosition, useFixed, options.maxFrames, minDataLength);
+    }
+    std::cout << "Multi-frame receive: " << spans.size() << " frames found (up to " << options.maxFrames << ")\n";
+    
+    std::vector<std::vector<std::complex<float>>> frames(spans.size());
+    LinkMetrics total = { 0, 0, 0, 0.0, 0.0 };
+    double errorSum = 0.0;
+    for (size_t i = 0; i < spans.size(); i++) {
+        std::cout << "  Frame " << i << ": position " << spans[i].start << ", " << spans[i].length << " samples\n";
+        std::vector<int> symbolValues;
+        processReceiveFrame(options, wordStore, spans[i].start, spans[i].length,
+                            g_filteredStartPilot.size(), g_filteredEndPilot.size(), frames[i], symbolValues);
+        if (options.measure) {
+            LinkMetrics metrics = measureAgainstReference(frames[i], symbolValues, options.demodOrder);
+            total.symbols += metrics.symbols;
+            total.bits += metrics.bits;
+            total.bitErrors += metrics.bitErrors;
+            errorSum += metrics.evm * metrics.evm * metrics.symbols;
+        }
+    }
+    
+    if (options.measure) {
+        // Symbol-weighted mean error power over the frames
+        if (total.symbols > 0) {
+            total.evm = std::sqrt(errorSum / total.symbols);
+            total.snrDb = total.evm > 0.0 ? -20.0 * std::log10(total.evm) : INFINITY;
+        }
+        return sendLinkMetrics(session, total, spans.size());
+    }
+    return sendFrameList(session, spans, frames);
+}
+
+bool handleReceiveCommand(ClientSession& session, const ReceiveOptions& options) {
     if (!g_adcZmod) {
         std::cerr << "ADC not initialized!" << std::endl;
         return false;
@@ -381,14 +1416,14 @@ bool handleReceiveCommand(int client_fd) {
     if (g_filteredStartPilot.empty() || g_filteredEndPilot.empty()) {
         std::cerr << "Filtered pilots not received yet! Run transmit first." << std::endl;
         const char* error_msg = "Error: Filtered pilots not available";
-        send(client_fd, error_msg, strlen(error_msg), 0);
+        session.sendError(error_msg);
         return false;
     }
     
     // Define constants for data acquisition
-    const int samplesPerSecond = 100000000; // 100MHz
+    const int samplesPerSecond = ADC_SAMPLES_PER_SECOND;
     const int maxSamplesToCollect = samplesPerSecond; // Up to 1 second
-    size_t batchSize = 500000; // Number of samples per batch
+    size_t batchSize = ADC_BATCH_SIZE; // Number of samples per batch
     
     // Get pilot lengths from stored filtered pilots
     const int startPilotLength = g_filteredStartPilot.size();
@@ -398,6 +1433,47 @@ bool handleReceiveCommand(int client_fd) {
     std::cout << "Start Pilot Length: " << startPilotLength << " samples\n";
     std::cout << "End Pilot Length: " << endPilotLength << " samples\n";
     
+    // The DAC repeats the last frame, so N + 1 frame lengths always contain N
+    // complete frames from start pilot to end pilot, wherever the capture begins
+    const int frameLength = (int)std::ceil(g_lastDacSampleCount * ADC_PER_DAC_SAMPLE);
+    int samplesToCollect = maxSamplesToCollect;
+    if (g_rxConfig.capture == CAPTURE_FRAME) {
+        samplesToCollect = (int)std::min<double>(maxSamplesToCollect,
+                                                 std::ceil(g_rxConfig.captureGuard * (options.maxFrames + 1.0) * frameLength));
+        // A short frame must not pull in, store and search a full batch past the window
+        if (samplesToCollect > 0) {
+            batchSize = std::min(batchSize, (size_t)samplesToCollect);
+        }
+    }
+    bool windowExtended = false;
+    // Trigger mode waits for the start pilot within the fixed budget, then commits
+    // pretrigger + posttrigger samples around it and does not look for the end pilot
+    const bool triggered = g_rxConfig.capture == CAPTURE_TRIGGER;
+    // Level mode replaces the capture engine with one hardware-triggered acquisition
+    // of pretrigger + posttrigger samples, searched for pilots as a single batch
+    const bool levelTriggered = g_rxConfig.capture == CAPTURE_LEVEL;
+    AdcTrigger levelTrigger;
+    if (levelTriggered) {
+        batchSize = (size_t)g_rxConfig.preTrigger + g_rxConfig.postTrigger;
+        samplesToCollect = (int)batchSize;
+        levelTrigger.channel = (uint8_t)(g_rxConfig.triggerChannel - 1);
+        levelTrigger.level = g_adcZmod->getSignedRawFromVolt(g_rxConfig.triggerLevel / ADC_SCALING_FACTOR, ADC_GAIN);
+        levelTrigger.edge = g_rxConfig.triggerEdge;
+        levelTrigger.window = g_rxConfig.preTrigger;
+        levelTrigger.timeout = TRIGGER_TIMEOUT;
+        std::cout << "Capture window: level trigger on channel " << g_rxConfig.triggerChannel << " at "
+                  << g_rxConfig.triggerLevel << " V (raw " << levelTrigger.level << "), "
+                  << (levelTrigger.edge == TRIGGER_FALLING ? "falling" : "rising") << " edge, "
+                  << g_rxConfig.preTrigger << " samples before and " << g_rxConfig.postTrigger << " from the trigger\n";
+    } else if (triggered) {
+        std::cout << "Capture window: pilot trigger, " << g_rxConfig.preTrigger << " samples before and "
+                  << g_rxConfig.postTrigger << " from the trigger\n";
+    } else {
+        std::cout << "Capture window: " << samplesToCollect << " samples ("
+                  << (g_rxConfig.capture == CAPTURE_FRAME ? "frame of " : "fixed, frame of ")
+                  << frameLength << " samples, guard " << g_rxConfig.captureGuard << ")\n";
+    }
+    
     // Calculate energies and find maximum values of the pilot sequences
     float startPilotEnergy = 0.0f;
     float endPilotEnergy = 0.0f;
@@ -434,31 +1510,57 @@ bool handleReceiveCommand(int client_fd) {
     std::cout << "Expected Signal Magnitude: " << expectedSignalMag << std::endl;
     
     // Thresholds
-    const float startPilotThreshold = 0.5f;  // Increased threshold for better reliability
-    const float endPilotThreshold = 0.5f;
+    const float startPilotThreshold = g_rxConfig.startThreshold;
+    const float endPilotThreshold = g_rxConfig.endThreshold;
     std::cout << "Detection Thresholds: Start=" << startPilotThreshold 
               << ", End=" << endPilotThreshold << std::endl;
+    
+    // The Q15 detector correlates the stored raw words directly
+    const bool useFixed = g_rxConfig.detector == DETECTOR_FIXED && g_fixedDetectorValid;
+    if (g_rxConfig.detector == DETECTOR_FIXED && !g_fixedDetectorValid) {
+        std::cout << "Q15 detector failed its conformance check, using float detector" << std::endl;
+    }
+    std::cout << "Detector: " << (useFixed ? "Q15 fixed-point" : "float FFT")
+              << (g_rxConfig.search == SEARCH_COARSE ? ", coarse-to-fine search" : ", exhaustive search") << std::endl;
     std::cout << "===================================\n\n";
     
-    // Create vector for received samples
-    std::vector<std::complex<float>> receivedSamples;
-    receivedSamples.reserve(maxSamplesToCollect);
+    // Bounded capture store of raw DMA words: the detection history plus, once the
+    // start pilot is found, everything after it. Samples are calibrated on demand.
+    const int maxPilotLength = std::max(startPilotLength, endPilotLength);
+    // A start pilot found next batch may begin up to a pilot length back in the history;
+    // a trigger capture also keeps its pre-trigger depth before that pilot
+    const int history = triggered ? g_rxConfig.preTrigger + maxPilotLength : maxPilotLength;
+    const size_t bytesPerSample = sizeof(uint32_t);
+    const size_t storeCapacity = (size_t)g_rxConfig.captureLimitMB * 1024 * 1024 / bytesPerSample;
+    if (storeCapacity < batchSize + history) {
+        std::cerr << "Capture limit of " << g_rxConfig.captureLimitMB << " MB is below one batch" << std::endl;
+        const char* error_msg = "Error: Capture limit too small";
+        session.sendError(error_msg);
+        return false;
+    }
+    CaptureStore<uint32_t> wordStore(storeCapacity);
+    std::cout << "Capture store: " << g_rxConfig.captureLimitMB << " MB cap, "
+              << storeCapacity << " samples" << std::endl;
+    resetPeakRss();
     
     // Timer and detection variables
     time_t startTime = time(NULL);
-    bool pilotFound = false;
-    bool endPilotFound = false;
-    int pilotPosition = -1;
-    int endPilotPosition = -1;
-    int totalSamplesCollected = 0;
+    PilotSearch search = { false, false, -1, -1, 0.0f, 0.0f };
+    int64_t totalSamplesCollected = 0;
     const int minExpectedDataLength = 300; // Minimum data length between pilots
     
     // Create debug logs
     std::ofstream corrLog("pilot_correlation.csv");
     corrLog << "Position,StartPilotCorr,EndPilotCorr,SignalMagnitude,StartCorrUnorm,EndCorrUnorm\n";
     
+#if ENABLE_SAMPLE_TRACE
     std::ofstream sampleTrace("sample_trace.csv");
     sampleTrace << "Index,Real,Imag,Magnitude,Phase\n";
+#endif
+    
+    // Scratch for converting the statistics chunks
+    std::vector<float> chunkReal(CONVERT_CHUNK_LENGTH);
+    std::vector<float> chunkImag(CONVERT_CHUNK_LENGTH);
     
     // Histogram for signal magnitudes
     const int magnitudeBins = 20;
@@ -471,10 +1573,54 @@ bool handleReceiveCommand(int client_fd) {
     float globalMaxEndCorr = 0.0f;
     int globalMaxEndPos = -1;
     
+    // Start the capture thread; this thread converts and searches the blocks
+    ZmodAdcSource adcSource(g_adcZmod, g_adcPool);
+    AdcCaptureEngine capture(adcSource, batchSize, ACQ_BUFFER_COUNT);
+    // The one-shot buffer is sized by the trigger settings, so it bypasses the pool
+    ZmodAdcSource levelSource(g_adcZmod);
+    uint32_t* levelBuffer = NULL;
+    bool levelFailed = false;
+    if (levelTriggered) {
+        levelBuffer = levelSource.allocBlock(batchSize);
+        if (!levelBuffer) {
+            std::cerr << "Failed to allocate a " << batchSize << " sample trigger buffer" << std::endl;
+            const char* error_msg = "Error: Trigger capture too long";
+            session.sendError(error_msg);
+            corrLog.close();
+            return false;
+        }
+    }
+    else if (!capture.start()) {
+        std::cerr << "Failed to start ADC capture!" << std::endl;
+        corrLog.close();
+        return false;
+    }
+    
     // Batch processing loop
     int batchNumber = 0;
 
-    while (totalSamplesCollected < maxSamplesToCollect) {
+    while (true) {
+    // Past the window, keep going only while a found start pilot still awaits its end pilot
+    if (totalSamplesCollected >= samplesToCollect) {
+        if (g_rxConfig.capture != CAPTURE_FRAME || !g_rxConfig.captureExtend || windowExtended ||
+            !search.startFound || search.endFound) {
+            break;
+        }
+        int64_t deadline = search.startPosition + (int64_t)std::ceil(g_rxConfig.captureGuard * frameLength) + endPilotLength;
+        samplesToCollect = (int)std::min<int64_t>(maxSamplesToCollect, deadline);
+        windowExtended = true;
+        std::cout << "End pilot not seen yet. Extending capture window to " << samplesToCollect << " samples.\n";
+        if (totalSamplesCollected >= samplesToCollect) {
+            break;
+        }
+    }
+    
+    if (triggered && search.startFound &&
+        totalSamplesCollected >= search.startPosition + g_rxConfig.postTrigger) {
+        std::cout << "Post-trigger length captured. Stopping collection." << std::endl;
+        break;
+    }
+    
     batchNumber++;
     std::cout << "\n===== PROCESSING BATCH #" << batchNumber << " =====\n";
     
@@ -485,195 +1631,254 @@ bool handleReceiveCommand(int client_fd) {
         break;
     }
     
-    // 如果pilots都已找到且数据有效，退出
-    if (pilotFound && endPilotFound && 
-        endPilotPosition > pilotPosition) {
+    // 如果pilots都已找到且数据有效，退出; a multi-frame receive fills the whole window
+    if (options.maxFrames == 1 && search.startFound && search.endFound && 
+        search.endPosition > search.startPosition) {
         std::cout << "Valid signal detected. Stopping collection." << std::endl;
         break;
     }
     
-    // 分配ADC缓冲区
-    uint32_t *adcBuffer = g_adcZmod->allocChannelsBuffer(batchSize);
-    if (!adcBuffer) {
-        std::cerr << "Failed to allocate ADC buffer!" << std::endl;
-        corrLog.close();
-        sampleTrace.close();
-        return false;
+    // 等待采集线程的下一个数据块, or block until the level trigger fires
+    CaptureBlock block;
+    if (levelTriggered) {
+        std::cout << "Waiting for the level trigger..." << std::endl;
+        size_t crossing;
+        if (!acquireLevelTriggered(levelSource, levelBuffer, batchSize, levelTrigger, crossing)) {
+            std::cout << "Level-triggered acquisition failed. Stopping collection." << std::endl;
+            levelFailed = true;
+            break;
+        }
+        block.buffer = levelBuffer;
+        block.length = batchSize;
+        block.sequence = 0;
+        block.discontinuity = false;
+        block.stalled = false;
+        
+        // The crossing should be the first sample after the pre-trigger window
+        if (crossing < batchSize) {
+            std::cout << "Level trigger: crossing at sample " << crossing << ", pre-trigger window "
+                      << levelTrigger.window << std::endl;
+        } else {
+            std::cout << "WARNING: no level crossing after the pre-trigger window" << std::endl;
+        }
+    }
+    else if (!capture.next(block, 1000000)) {
+        std::cout << "No ADC block available. Stopping collection." << std::endl;
+        break;
     }
     
-    // 获取数据
-    g_adcZmod->acquireImmediatePolling(adcBuffer, batchSize);
+    uint32_t *adcBuffer = block.buffer;
+    if (!levelTriggered) {
+        std::cout << "Block #" << block.sequence << ", queued " << capture.queued() << "/"
+                  << capture.bufferCount() << std::endl;
+    }
+    if (block.stalled) {
+        std::cout << "WARNING: capture gap before block #" << block.sequence
+                  << " - DSP fell behind the ADC" << std::endl;
+    }
+    else if (block.discontinuity && block.sequence == 1) {
+        std::cout << "NOTE: the ADC is re-armed for every block, so samples between blocks are not captured"
+                  << std::endl;
+    }
     
     // 处理样本
-    int batchStartIndex = totalSamplesCollected;
+    int64_t batchStartIndex = totalSamplesCollected;
+    
+    // Retain the next search's history, or everything from the start pilot on
+    const int keepBefore = triggered ? g_rxConfig.preTrigger : 0;
+    uint64_t keepFrom = search.startFound ? std::max<int64_t>(0, search.startPosition - keepBefore)
+                                          : std::max<int64_t>(0, batchStartIndex - history);
+    uint32_t* storedWords = wordStore.reserve(batchSize, keepFrom);
+    if (!storedWords) {
+        std::cout << "Capture store full (" << g_rxConfig.captureLimitMB
+                  << " MB). Stopping collection." << std::endl;
+        if (!levelTriggered) {
+            capture.release(block);
+        }
+        break;
+    }
     
     // 本批次统计
     float maxMagnitude = 0.0f;
     float avgMagnitude = 0.0f;
     
-    for (int i = 0; i < batchSize; i++) {
-        int16_t realRaw = g_adcZmod->signedChannelData(0, adcBuffer[i]);
-        int16_t imagRaw = g_adcZmod->signedChannelData(1, adcBuffer[i]);
-        
-        float realVolt = g_adcZmod->getVoltFromSignedRaw(realRaw, ADC_GAIN) * ADC_SCALING_FACTOR;
-        float imagVolt = g_adcZmod->getVoltFromSignedRaw(imagRaw, ADC_GAIN) * ADC_SCALING_FACTOR;
-        
-        float magnitude = std::sqrt(realVolt*realVolt + imagVolt*imagVolt);
-        float phase = std::atan2(imagVolt, realVolt) * 180.0f / M_PI;
-        
-        maxMagnitude = std::max(maxMagnitude, magnitude);
-        avgMagnitude += magnitude;
+    // 存储样本 as the packed DMA words
+    std::copy(adcBuffer, adcBuffer + batchSize, storedWords);
+    
+    // Statistics from short converted chunks; no float copy of the batch is kept
+    for (size_t chunkStart = 0; chunkStart < batchSize; chunkStart += CONVERT_CHUNK_LENGTH) {
+        size_t chunkLength = std::min((size_t)CONVERT_CHUNK_LENGTH, batchSize - chunkStart);
+        g_adcConverter->convert(adcBuffer + chunkStart, chunkLength, chunkReal.data(), chunkImag.data());
         
-        // 更新直方图
-        int binIndex = std::min(magnitudeBins - 1, static_cast<int>(magnitude * magnitudeBins / maxMagnitudeForHistogram));
-        if (binIndex >= 0) {
-            magnitudeHistogram[binIndex]++;
+        for (size_t i = 0; i < chunkLength; i++) {
+            float realVolt = chunkReal[i];
+            float imagVolt = chunkImag[i];
+            
+            float magnitude = std::sqrt(realVolt*realVolt + imagVolt*imagVolt);
+            
+            maxMagnitude = std::max(maxMagnitude, magnitude);
+            avgMagnitude += magnitude;
+            
+            // 更新直方图
+            int binIndex = std::min(magnitudeBins - 1, static_cast<int>(magnitude * magnitudeBins / maxMagnitudeForHistogram));
+            if (binIndex >= 0) {
+                magnitudeHistogram[binIndex]++;
+            }
+            
+#if ENABLE_SAMPLE_TRACE
+            // 记录样本
+            float phase = std::atan2(imagVolt, realVolt) * 180.0f / M_PI;
+            sampleTrace << (totalSamplesCollected + chunkStart + i) << "," 
+                        << realVolt << "," << imagVolt << "," 
+                        << magnitude << "," << phase << "\n";
+#endif
         }
-        
-        // 存储样本
-        receivedSamples.push_back(std::complex<float>(realVolt, imagVolt));
-        
-        // 记录样本
-        sampleTrace << (totalSamplesCollected + i) << "," 
-                    << realVolt << "," << imagVolt << "," 
-                    << magnitude << "," << phase << "\n";
     }
     
     // 更新样本计数并释放缓冲区
     totalSamplesCollected += batchSize;
-    g_adcZmod->freeChannelsBuffer(adcBuffer, batchSize);
+    if (!levelTriggered) {
+        capture.release(block);
+    }
     
 
     //下面开始的相关性检测应该就算没问题了
     // 执行相关性检测
-    if (receivedSamples.size() >= std::max(startPilotLength, endPilotLength)) {
+    if (totalSamplesCollected >= maxPilotLength) {
         // 搜索范围
-        int searchStart = std::max(0, batchStartIndex - std::max(startPilotLength, endPilotLength));
-        int searchEnd = totalSamplesCollected - std::max(startPilotLength, endPilotLength);
+        int64_t searchStart = std::max<int64_t>(0, batchStartIndex - maxPilotLength);
+        int64_t searchEnd = totalSamplesCollected - maxPilotLength;
         
         std::cout << "Searching in range [" << searchStart << ", " << searchEnd << "]\n";
         
-        // 追踪最后有效的检测位置
-        static int last_valid_start_pos = -1;
-        static float last_valid_start_corr = 0.0f;
-        static int last_valid_end_pos = -1;
-        static float last_valid_end_corr = 0.0f;
+        size_t searchCount = std::max<int64_t>(0, searchEnd - searchStart);
+        const uint32_t* window = wordStore.at(searchStart);
         
-        // 相关性计算步长
-        int stepSize = 1;
+        // Calibrated sample at a stored stream position
+        auto sampleAt = [&wordStore](uint64_t position) {
+            std::complex<float> sample;
+            g_adcConverter->convertComplex(wordStore.at(position), 1, &sample);
+            return sample;
+        };
         
-        // 对每个位置计算相关性
-        for (int pos = searchStart; pos < searchEnd; pos += stepSize) {
-            if ((pos - searchStart) % 10000 == 0 && pos > searchStart) {
-                std::cout << "Processed " << (pos - searchStart) << " positions..." << std::endl;
-            }
-            
-            // 确保有足够的样本进行相关性计算
-            if (pos + std::max(startPilotLength, endPilotLength) > receivedSamples.size()) {
-                continue;
-            }
-            
-            // 计算归一化因子
-            float signalEnergyStart = 0.0f;
-            float signalEnergyEnd = 0.0f;
-            
-            for (int i = 0; i < startPilotLength && pos + i < receivedSamples.size(); i++) {
-                signalEnergyStart += std::norm(receivedSamples[pos + i]);
-            }
-            
-            if (startPilotLength != endPilotLength) {
-                for (int i = 0; i < endPilotLength && pos + i < receivedSamples.size(); i++) {
-                    signalEnergyEnd += std::norm(receivedSamples[pos + i]);
-                }
-            } else {
-                signalEnergyEnd = signalEnergyStart;
-            }
-            
-            // Start pilot相关性计算
-            std::complex<float> startCorr(0.0f, 0.0f);
-            if (!pilotFound) {
-                for (int i = 0; i < startPilotLength && pos + i < receivedSamples.size(); i++) {
-                    startCorr += receivedSamples[pos + i] * std::conj(g_filteredStartPilot[i]);
-                }
+        // Correlation outputs; positions where a pilot is not searched stay zero
+        std::vector<float> startCorrMag(searchCount, 0.0f);
+        std::vector<float> endCorrMag(searchCount, 0.0f);
+        std::vector<float> startCorrNorm(searchCount, 0.0f);
+        std::vector<float> endCorrNorm(searchCount, 0.0f);
+        
+        // End pilot correlation is active from the first position after the start pilot
+        size_t endSearchFrom = search.startFound ? 0 : searchCount;
+        
+        // Start pilot相关性计算
+        if (!search.startFound && searchCount > 0) {
+            // The trigger always uses the cheap coarse-to-fine search
+            SearchMode startSearch = triggered ? SEARCH_COARSE : g_rxConfig.search;
+            size_t refined = searchPilot(searchContext(), g_startDetector, useFixed, startSearch, window,
+                                         searchCount, startCorrNorm.data(), startCorrMag.data());
+            if (startSearch == SEARCH_COARSE) {
+                std::cout << "Start pilot: refined " << refined << " of " << searchCount << " positions\n";
             }
             
-            // End pilot相关性计算
-            std::complex<float> endCorr(0.0f, 0.0f);
-            if (pilotFound) {
-                for (int i = 0; i < endPilotLength && pos + i < receivedSamples.size(); i++) {
-                    endCorr += receivedSamples[pos + i] * std::conj(g_filteredEndPilot[i]);
+            for (size_t k = 0; k < searchCount; k++) {
+                if (startCorrNorm[k] > startPilotThreshold) {
+                    search.startFound = true;
+                    search.startPosition = searchStart + k;
+                    search.startScore = startCorrNorm[k];
+                    std::cout << "*** START PILOT DETECTED at position " << search.startPosition 
+                            << " with correlation " << startCorrNorm[k] << " ***\n";
+                    
+                    // 打印调试信息
+                    std::cout << "Start pilot signal samples:\n";
+                    for (int i = 0; i < 10 && (uint64_t)search.startPosition + i < wordStore.end(); i++) {
+                        std::complex<float> sample = sampleAt(search.startPosition + i);
+                        std::cout << "[" << i << "]: " << sample.real() << " + " << sample.imag() << "j\n";
+                    }
+                    
+                    // Positions after the detection no longer evaluate the start pilot
+                    std::fill(startCorrMag.begin() + k + 1, startCorrMag.end(), 0.0f);
+                    std::fill(startCorrNorm.begin() + k + 1, startCorrNorm.end(), 0.0f);
+                    endSearchFrom = k + 1;
+                    break;
                 }
             }
-            
-            // 归一化相关性
-            float startCorrNorm = 0.0f;
-            float endCorrNorm = 0.0f;
-            
-            if (signalEnergyStart > 0 && !pilotFound) {
-                startCorrNorm = std::abs(startCorr) / std::sqrt(signalEnergyStart * startPilotEnergy);
-                if (startCorrNorm > 1.0f) startCorrNorm = 1.0f;
-            }
-            
-            if (signalEnergyEnd > 0 && pilotFound) {
-                endCorrNorm = std::abs(endCorr) / std::sqrt(signalEnergyEnd * endPilotEnergy);
-                if (endCorrNorm > 1.0f) endCorrNorm = 1.0f;
+        }
+        
+        // End pilot相关性计算
+        if (search.startFound && !triggered && endSearchFrom < searchCount) {
+            size_t refined = searchPilot(searchContext(), g_endDetector, useFixed, g_rxConfig.search,
+                                         window + endSearchFrom, searchCount - endSearchFrom,
+                                         endCorrNorm.data() + endSearchFrom, endCorrMag.data() + endSearchFrom);
+            if (g_rxConfig.search == SEARCH_COARSE) {
+                std::cout << "End pilot: refined " << refined << " of " << (searchCount - endSearchFrom) << " positions\n";
             }
             
-            // Start pilot
-            if (!pilotFound && startCorrNorm > startPilotThreshold) {
-                pilotFound = true;
-                pilotPosition = pos;
-                std::cout << "*** START PILOT DETECTED at position " << pilotPosition 
-                        << " with correlation " << startCorrNorm << " ***\n";
+            for (size_t k = endSearchFrom; k < searchCount; k++) {
+                int64_t pos = searchStart + k;
                 
-                // 打印调试信息
-                std::cout << "Start pilot signal samples:\n";
-                for (int i = 0; i < 10 && pilotPosition + i < receivedSamples.size(); i++) {
-                    std::complex<float> sample = receivedSamples[pilotPosition + i];
-                    std::cout << "[" << i << "]: " << sample.real() << " + " << sample.imag() << "j\n";
+                if (!search.endFound && pos >= (int64_t)frameEndFrom(search.startPosition, minExpectedDataLength) &&
+                    endCorrNorm[k] > endPilotThreshold) {
+                    search.endFound = true;
+                    search.endPosition = pos;
+                    search.endScore = endCorrNorm[k];
+                    std::cout << "*** END PILOT DETECTED at position " << search.endPosition 
+                            << " with correlation " << endCorrNorm[k] << " ***\n";
+                    
+                    // 打印调试信息
+                    std::cout << "End pilot signal samples:\n";
+                    for (int i = 0; i < 10 && (uint64_t)search.endPosition + i < wordStore.end(); i++) {
+                        std::complex<float> sample = sampleAt(search.endPosition + i);
+                        std::cout << "[" << i << "]: " << sample.real() << " + " << sample.imag() << "j\n";
+                    }
                 }
             }
-
-            // End pilot
-            if (pilotFound && !endPilotFound && pos > pilotPosition && 
-                endCorrNorm > endPilotThreshold) {
-                
-                endPilotFound = true;
-                endPilotPosition = pos;
-                std::cout << "*** END PILOT DETECTED at position " << endPilotPosition 
-                        << " with correlation " << endCorrNorm << " ***\n";
-                
-                // 打印调试信息
-                std::cout << "End pilot signal samples:\n";
-                for (int i = 0; i < 10 && endPilotPosition + i < receivedSamples.size(); i++) {
-                    std::complex<float> sample = receivedSamples[endPilotPosition + i];
-                    std::cout << "[" << i << "]: " << sample.real() << " + " << sample.imag() << "j\n";
+        }
+        
+        // 记录相关性数据 (mean magnitude over the next 100 samples, kept as a running sum)
+        const int meanWindow = 100;
+        double magnitudeSum = 0.0;
+        int windowFill = 0;
+        for (size_t k = 0; k < searchCount; k++) {
+            int64_t pos = searchStart + k;
+            int sampleCount = (int)std::min<int64_t>(meanWindow, (int64_t)wordStore.end() - pos);
+            if (k == 0) {
+                for (int i = 0; i < sampleCount; i++) {
+                    magnitudeSum += std::abs(sampleAt(pos + i));
                 }
-                
-                // 检查位置关系
-                if (endPilotPosition <= pilotPosition) {
-                    endPilotFound = false;
-                    endPilotPosition = -1;
-                    std::cout << "End pilot detected before start pilot - continuing search\n";
+            } else {
+                magnitudeSum -= std::abs(sampleAt(pos - 1));
+                if (sampleCount == windowFill) {
+                    magnitudeSum += std::abs(sampleAt(pos + sampleCount - 1));
                 }
             }
-
-
-            // 记录相关性数据
-            float signalMeanMag = 0.0f;
-            int sampleCount = std::min(100, (int)(receivedSamples.size() - pos));
-            for (int i = 0; i < sampleCount; i++) {
-                signalMeanMag += std::abs(receivedSamples[pos + i]);
-            }
-            signalMeanMag /= sampleCount;
+            windowFill = sampleCount;
+            float signalMeanMag = (float)(magnitudeSum / sampleCount);
             
-            corrLog << pos << "," << startCorrNorm << "," << endCorrNorm << "," 
-                    << signalMeanMag << "," << std::abs(startCorr) << "," << std::abs(endCorr) << "\n";
+            corrLog << pos << "," << startCorrNorm[k] << "," << endCorrNorm[k] << "," 
+                    << signalMeanMag << "," << startCorrMag[k] << "," << endCorrMag[k] << "\n";
         }
     }
 }
 
 
+    if (levelTriggered) {
+        levelSource.freeBlock(levelBuffer, batchSize);
+        if (levelFailed) {
+            const char* error_msg = "Error: Level trigger not seen";
+            session.sendError(error_msg);
+            corrLog.close();
+            return false;
+        }
+    } else {
+        capture.stop();
+        std::cout << "Capture: " << capture.blocksCaptured() << " blocks, queue high-water "
+                  << capture.highWater() << "/" << capture.bufferCount()
+                  << ", overruns " << capture.overruns()
+                  << ", discontinuities " << capture.discontinuities()
+                  << " (" << capture.stalls() << " stalls)" << std::endl;
+        g_adcPool->printStats();
+    }
+    
     // Print magnitude histogram
     std::cout << "\n===== SIGNAL MAGNITUDE HISTOGRAM =====\n";
     int totalSamples = 0;
@@ -693,31 +1898,52 @@ bool handleReceiveCommand(int client_fd) {
     
     // Close logs
     corrLog.close();
+#if ENABLE_SAMPLE_TRACE
     sampleTrace.close();
+#endif
     
-    // Determine what data to send to MATLAB
-    int dataStart = 0;
-    int dataLength = receivedSamples.size();
+    if (options.maxFrames > 1 && !triggered) {
+        return replyMultipleFrames(session, options, wordStore, search, useFixed, minExpectedDataLength);
+    }
+    
+    // Determine what data to send to MATLAB; without pilots only the retained tail is left
+    // Positions are 64-bit stream indices; lengths are bounded by the store and stay int
+    int64_t dataStart = wordStore.begin();
+    int dataLength = wordStore.size();
+    // Pilot samples at either end of the extracted data, excluded from demodulation
+    int leadingPilot = 0;
+    int trailingPilot = 0;
     
     std::cout << "\n===== PREPARING DATA FOR TRANSMISSION =====\n";
     
-    if (pilotFound && endPilotFound && 
-        endPilotPosition > pilotPosition && 
-        (endPilotPosition - pilotPosition) > minExpectedDataLength) {
+    if (triggered && search.startFound) {
+        // Pre-trigger history that is still stored, then the post-trigger length
+        dataStart = std::max<int64_t>(wordStore.begin(), search.startPosition - g_rxConfig.preTrigger);
+        dataLength = (int)(std::min<int64_t>(wordStore.end(), search.startPosition + g_rxConfig.postTrigger) - dataStart);
+        leadingPilot = (dataStart == search.startPosition) ? startPilotLength : 0;
+        std::cout << "Sending triggered capture.\n";
+        std::cout << "  Trigger position: " << search.startPosition << "\n";
+        std::cout << "  Pre-trigger: " << (search.startPosition - dataStart) << " samples\n";
+        std::cout << "  Data length: " << dataLength << " samples\n";
+    }
+    else if (search.startFound && search.endFound) {
         // Extract data including both pilots
-        dataStart = pilotPosition;
-        dataLength = (endPilotPosition + endPilotLength) - pilotPosition;
-        //dataLength = endPilotPosition - pilotPosition;
+        dataStart = search.startPosition;
+        dataLength = (int)(search.endPosition + endPilotLength - search.startPosition);
+        //dataLength = search.endPosition - search.startPosition;
+        leadingPilot = startPilotLength;
+        trailingPilot = endPilotLength;
         std::cout << "Sending data with both pilots.\n";
         std::cout << "  Start position: " << dataStart << "\n";
         std::cout << "  End position: " << (dataStart + dataLength - 1) << "\n";
         std::cout << "  Data length: " << dataLength << " samples\n";
     }
 
-    else if (pilotFound) {
+    else if (search.startFound) {
         // Only start pilot found - send from start pilot to end of buffer
-        dataStart = pilotPosition;
-        dataLength = receivedSamples.size() - pilotPosition;
+        dataStart = search.startPosition;
+        dataLength = (int)(wordStore.end() - search.startPosition);
+        leadingPilot = startPilotLength;
         
         std::cout << "Only start pilot found. Sending from start pilot to end.\n";
         std::cout << "  Start position: " << dataStart << "\n";
@@ -725,47 +1951,41 @@ bool handleReceiveCommand(int client_fd) {
     }
     else {
         // No pilots found - send all collected data
-        std::cout << "No pilots found. Sending all collected data.\n";
+        std::cout << "No pilots found. Sending the retained capture.\n";
         std::cout << "  Data length: " << dataLength << " samples\n";
     }
     
     // Safety checks
-    if (dataStart < 0) {
-        std::cout << "WARNING: Negative data start index. Resetting to 0.\n";
-        dataStart = 0;
+    if (dataStart < (int64_t)wordStore.begin()) {
+        std::cout << "WARNING: Data start was dropped from the capture store. Resetting.\n";
+        dataStart = wordStore.begin();
+        leadingPilot = 0;
     }
     
-    if (dataStart + dataLength > receivedSamples.size()) {
+    if (dataStart + dataLength > (int64_t)wordStore.end()) {
         std::cout << "WARNING: Data extends beyond buffer. Truncating.\n";
-        dataLength = receivedSamples.size() - dataStart;
+        dataLength = (int)(wordStore.end() - dataStart);
+        trailingPilot = 0;
     }
     
-    // Send the sample count to MATLAB
-    char sampleCountStr[32];
-    sprintf(sampleCountStr, "SAMPLES=%d", dataLength);
-    std::cout << "Sending sample count: " << sampleCountStr << std::endl;
-    
-    if (send(client_fd, sampleCountStr, strlen(sampleCountStr), 0) < 0) {
-        perror("Failed to send sample count string");
-        return false;
+    std::vector<std::complex<float>> frame;
+    std::vector<int> symbolValues;
+    processReceiveFrame(options, wordStore, dataStart, dataLength, leadingPilot, trailingPilot, frame, symbolValues);
+    if (options.measure) {
+        return sendLinkMetrics(session, measureAgainstReference(frame, symbolValues, options.demodOrder), 1);
     }
+    // Without on-board stages the frame is a plain calibration of the capture words
+    const bool unprocessed = !options.carrierCorrection && !options.matchedFilter &&
+                             options.resampleUp == options.resampleDown && options.demodOrder == 0;
+    dataLength = frame.size();
     
-    usleep(500000);  // 10ms delay
-    
-    // Prepare arrays for transmission
-    float* realPart = new float[dataLength];
-    float* imagPart = new float[dataLength];
-    
-    // Fill arrays and analyze signal
+    // Analyze signal
     float avgMagnitude = 0.0f;
     float maxMagnitude = 0.0f;
     float minMagnitude = std::numeric_limits<float>::max();
     
     for (int i = 0; i < dataLength; i++) {
-        realPart[i] = receivedSamples[dataStart + i].real();
-        imagPart[i] = receivedSamples[dataStart + i].imag();
-        
-        float magnitude = std::sqrt(realPart[i]*realPart[i] + imagPart[i]*imagPart[i]);
+        float magnitude = std::abs(frame[i]);
         avgMagnitude += magnitude;
         maxMagnitude = std::max(maxMagnitude, magnitude);
         minMagnitude = std::min(minMagnitude, magnitude);
@@ -785,42 +2005,54 @@ bool handleReceiveCommand(int client_fd) {
     dataFile << "Index,Real,Imag,Magnitude,Phase\n";
     
     for (int i = 0; i < dataLength; i++) {
-        float magnitude = std::sqrt(realPart[i]*realPart[i] + imagPart[i]*imagPart[i]);
-        float phase = std::atan2(imagPart[i], realPart[i]) * 180.0f / M_PI;
-        dataFile << i << "," << realPart[i] << "," << imagPart[i] << ","
+        float magnitude = std::abs(frame[i]);
+        float phase = std::arg(frame[i]) * 180.0f / M_PI;
+        dataFile << i << "," << frame[i].real() << "," << frame[i].imag() << ","
                 << magnitude << "," << phase << "\n";
     }
     dataFile.close();
     
-    // Send real part to MATLAB
-    std::cout << "Sending real part data (" << dataLength << " samples) to MATLAB..." << std::endl;
-    if (send(client_fd, realPart, dataLength * sizeof(float), 0) < 0) {
-        perror("Send real data failed");
-        delete[] realPart;
-        delete[] imagPart;
-        return false;
+    if (options.replyBits) {
+        return sendPackedBits(session, symbolValues, options.demodOrder);
     }
     
-    usleep(100000);  // 100ms delay
+    // Send the sample count, then the samples in the session format to MATLAB
+    char sampleCountStr[32];
+    sprintf(sampleCountStr, "SAMPLES=%d", dataLength);
+    std::cout << "Sending sample count: " << sampleCountStr << std::endl;
     
-    // Send imaginary part to MATLAB
-    std::cout << "Sending imaginary part data (" << dataLength << " samples) to MATLAB..." << std::endl;
-    if (send(client_fd, imagPart, dataLength * sizeof(float), 0) < 0) {
-        perror("Send imaginary data failed");
-        delete[] realPart;
-        delete[] imagPart;
+    DataSegment noPrefix = { NULL, 0 };
+    if (!sendSamples(session, sampleCountStr, noPrefix, frame, unprocessed ? wordStore.at(dataStart) : NULL)) {
+        perror("Send sample data failed");
         return false;
     }
     
-    // Clean up
-    delete[] realPart;
-    delete[] imagPart;
     
     std::cout << "\nADC data transmission complete - sent " << dataLength << " samples" << std::endl;
+    std::cout << "Capture store: " << (wordStore.allocated() * bytesPerSample) / (1024 * 1024)
+              << " MB allocated, " << wordStore.dropped() << " samples dropped; peak RSS "
+              << readPeakRssKb() << " kB" << std::endl;
     
     return true;
 }
 
+// Release the DMA pools and the ZMOD devices; pooled buffers go back first
+void releaseHardware() {
+    delete g_adcConverter;
+    delete g_dacPacker;
+    g_adcConverter = NULL;
+    g_dacPacker = NULL;
+    g_dacZeroWave.reset();
+    delete g_adcPool;
+    delete g_dacPool;
+    g_adcPool = NULL;
+    g_dacPool = NULL;
+    delete g_dacZmod;
+    delete g_adcZmod;
+    g_dacZmod = NULL;
+    g_adcZmod = NULL;
+}
+
 int main() {
     int server_fd, client_fd;
     struct sockaddr_in server_addr, client_addr;
@@ -848,15 +2080,38 @@ int main() {
         return 1;
     }
     
+    // Reserve the DMA buffer pools once, so commands do not map and unmap CMA buffers
+    g_adcPool = new DmaBufferPool("ADC",
+        [](size_t length) { return g_adcZmod->allocChannelsBuffer(length); },
+        [](uint32_t* buf, size_t length) { g_adcZmod->freeChannelsBuffer(buf, length); });
+    g_dacPool = new DmaBufferPool("DAC",
+        [](size_t length) { return g_dacZmod->allocChannelsBuffer(length); },
+        [](uint32_t* buf, size_t length) { g_dacZmod->freeChannelsBuffer(buf, length); });
+    
+    g_adcPool->reserve(ADC_POOL_SMALL_LENGTH, 1);
+    g_adcPool->reserve(ADC_BATCH_SIZE, ACQ_BUFFER_COUNT);
+    g_dacPool->reserve(DAC_ZERO_LENGTH, 1);
+    g_dacPool->reserve(DAC_POOL_WAVE_LENGTH, DAC_POOL_WAVE_COUNT);
+    
+    g_dacZeroWave = g_dacPool->lease(DAC_ZERO_LENGTH);
+    if (g_dacZeroWave) {
+        memset(g_dacZeroWave.data(), 0, DAC_ZERO_LENGTH * sizeof(uint32_t));
+    }
+    std::cout << "DMA pools reserved: ADC " << g_adcPool->reservedBytes() << " bytes, DAC "
+              << g_dacPool->reservedBytes() << " bytes" << std::endl;
+    
     // Set ADC gain for channel 0 (CH1) and channel 1 (CH2)
     g_adcZmod->setGain(0, ADC_GAIN); // Fixed gain setting
     g_adcZmod->setGain(1, ADC_GAIN); // Fixed gain setting
     
+    g_adcConverter = new AdcIqConverter(g_adcZmod, ADC_GAIN, ADC_SCALING_FACTOR);
+    g_dacPacker = new DacIqPacker(g_dacZmod, DAC_GAIN);
+    updateMatchedFilter();
+    
     // Create socket
     if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
         perror("Socket creation failed");
-        delete g_dacZmod;
-        delete g_adcZmod;
+        releaseHardware();
         return 1;
     }
     
@@ -864,8 +2119,7 @@ int main() {
     int opt = 1;
     if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
         perror("setsockopt(SO_REUSEADDR) failed");
-        delete g_dacZmod;
-        delete g_adcZmod;
+        releaseHardware();
         return 1;
     }
     
@@ -885,19 +2139,22 @@ int main() {
     // Bind socket to port
     if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
         perror("Bind failed");
-        delete g_dacZmod;
-        delete g_adcZmod;
+        releaseHardware();
         return 1;
     }
     
     // Listen for connections
     if (listen(server_fd, 1) < 0) {
         perror("Listen failed");
-        delete g_dacZmod;
-        delete g_adcZmod;
+        releaseHardware();
         return 1;
     }
     
+    // One correlation worker per core; the receive thread itself is one of them
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    g_threadPool = new ThreadPool(cores);
+    printf("Correlation thread pool: %zu threads\n", g_threadPool->size());
+    
     printf("Server listening on port %d...\n", SERVER_PORT);
     
     while (running) {
@@ -921,17 +2178,11 @@ int main() {
         #endif
         
         bool dac_transmitting = false;
+        ClientSession session(client_fd);
         
         while (running) {
-            memset(buffer, 0, BUFFER_SIZE);
-            ssize_t bytes_read = recv(client_fd, buffer, BUFFER_SIZE, 0);
-            
-            if (bytes_read <= 0) {
-                if (bytes_read == 0) {
-                    printf("Client disconnected\n");
-                } else {
-                    perror("Receive failed");
-                }
+            if (!session.readCommand(buffer, BUFFER_SIZE)) {
+                printf("Client disconnected\n");
                 break;
             }
             
@@ -939,7 +2190,7 @@ int main() {
             
             // New command for filtered pilots
             if (strcmp(buffer, "filtered_pilots") == 0) {
-                if (!receiveFilteredPilots(client_fd)) {
+                if (!receiveFilteredPilots(session)) {
                     perror("Failed to receive filtered pilots");
                 }
             }
@@ -949,7 +2200,7 @@ int main() {
                 
                 // Reply to client
                 const char* reply = "Ready for data";
-                if (send(client_fd, reply, strlen(reply), 0) < 0) {
+                if (!session.sendText(reply)) {
                     perror("Send failed");
                     break;
                 }
@@ -958,75 +2209,132 @@ int main() {
                 
                 // First receive the data length as int32
                 int32_t dataLength = 0;
-                if (!receiveExactBytes(client_fd, &dataLength, sizeof(int32_t))) {
+                if (!session.receive(&dataLength, sizeof(int32_t))) {
                     perror("Failed to receive data length");
                     break;
                 }
                 
                 printf("Received data length: %d samples\n", dataLength);
-                
-                // Allocate buffers for real and imaginary parts
-                float* imagPart = new float[dataLength];
-                float* realPart = new float[dataLength];
-                
-                // Receive imaginary part
-                printf("Receiving imaginary part...\n");
-                if (!receiveExactBytes(client_fd, imagPart, dataLength * sizeof(float))) {
-                    perror("Failed to receive imaginary data");
-                    delete[] imagPart;
-                    delete[] realPart;
+                if (dataLength < 0) {
                     break;
                 }
-                
-                // Receive real part
-                printf("Receiving real part...\n");
-                if (!receiveExactBytes(client_fd, realPart, dataLength * sizeof(float))) {
-                    perror("Failed to receive real data");
-                    delete[] imagPart;
-                    delete[] realPart;
+                if (dataLength > DAC_POOL_WAVE_LENGTH) {
+                    // Checked before anything is allocated; the upload that follows cannot be skipped, so the connection ends
+                    char error_msg[100];
+                    snprintf(error_msg, sizeof(error_msg), "Error: Transmit length %d exceeds the DAC waveform memory of %d samples",
+                             dataLength, DAC_POOL_WAVE_LENGTH);
+                    session.sendError(error_msg);
                     break;
                 }
                 
-                // Generate DAC waveform
-                dacGenerateFromComplex(realPart, imagPart, dataLength);
-                
-                // Free the allocated memory
-                delete[] realPart;
-                delete[] imagPart;
+                if (session.sampleFormat() != SAMPLE_FORMAT_FLOAT32_PLANAR) {
+                    // Interleaved uploads go straight into the DMA buffer
+                    if (!dacReceiveInterleaved(session, session.sampleFormat(), dataLength)) {
+                        perror("Failed to receive interleaved data");
+                        break;
+                    }
+                }
+                else {
+                    // The imaginary parts come first; both land in their buffers in one scattered read
+                    std::vector<float> imagPart(dataLength);
+                    std::vector<float> realPart(dataLength);
+                    ReceiveSegment segments[] = {
+                        { imagPart.data(), dataLength * sizeof(float) },
+                        { realPart.data(), dataLength * sizeof(float) }
+                    };
+                    printf("Receiving imaginary and real parts...\n");
+                    if (!session.receive(segments, 2)) {
+                        perror("Failed to receive transmit data");
+                        break;
+                    }
+                    
+                    // Generate DAC waveform
+                    dacGenerateFromComplex(realPart.data(), imagPart.data(), dataLength);
+                }
                 
                 // Confirm to client
                 char confirm_buf[100];
                 snprintf(confirm_buf, sizeof(confirm_buf), "Transmission started with %d samples", dataLength);
-                if (send(client_fd, confirm_buf, strlen(confirm_buf), 0) < 0) {
+                if (!session.sendText(confirm_buf)) {
                     perror("Send confirmation failed");
                     break;
                 }
             }
-            else if (strcmp(buffer, "receive") == 0) {
-                // Handle receive command - ADC->MATLAB
+            else if (strncmp(buffer, "config", 6) == 0 && (buffer[6] == ' ' || buffer[6] == '\0')) {
+                // Update receive-path settings
+                if (!handleConfigCommand(session, buffer + 6)) {
+                    printf("Config command rejected\n");
+                }
+            }
+            else if (strncmp(buffer, "format", 6) == 0 && (buffer[6] == ' ' || buffer[6] == '\0')) {
+                // Sample layout of later uploads and replies on this connection
+                if (!handleFormatCommand(session, buffer + 6)) {
+                    printf("Format command rejected\n");
+                }
+            }
+            else if (strncmp(buffer, "receive", 7) == 0 && (buffer[7] == ' ' || buffer[7] == '\0')) {
+                // Handle receive command - ADC->MATLAB, optionally with on-board filtering
                 printf("Handling receive command from MATLAB\n");
-                if (!handleReceiveCommand(client_fd)) {
+                ReceiveOptions options;
+                if (!parseReceiveOptions(buffer + 7, options)) {
+                    const char* reply = "Error: invalid receive option";
+                    if (!session.sendError(reply)) {
+                        perror("Send failed");
+                        break;
+                    }
+                }
+                else if (!handleReceiveCommand(session, options)) {
                     perror("Receive operation failed");
                 }
             }
+            else if (strncmp(buffer, "reference", 9) == 0 && (buffer[9] == ' ' || buffer[9] == '\0')) {
+                // Store the transmitted payload for "measure"
+                printf("Handling reference upload from MATLAB\n");
+                if (!receiveReference(session, buffer[9] ? buffer + 10 : "")) {
+                    perror("Reference upload failed");
+                }
+            }
+            else if (strncmp(buffer, "measure", 7) == 0 && (buffer[7] == ' ' || buffer[7] == '\0')) {
+                // Receive and demodulate a frame, reply with BER/EVM/SNR only
+                printf("Handling measure command from MATLAB\n");
+                ReceiveOptions options;
+                const char* error_msg = NULL;
+                if (!parseReceiveOptions(buffer + 7, options) || options.demodOrder == 0) {
+                    error_msg = "Error: measure needs valid receive options including demod=M and resample=20/21";
+                } else if (g_referenceValues.empty()) {
+                    error_msg = "Error: no reference uploaded";
+                } else if (!g_referenceIsBits && options.demodOrder > 256) {
+                    error_msg = "Error: symbol references are limited to 256-QAM";
+                } else if (!g_referenceIsBits &&
+                           *std::max_element(g_referenceValues.begin(), g_referenceValues.end()) >= options.demodOrder) {
+                    error_msg = "Error: reference symbols exceed the QAM order";
+                }
+                if (error_msg) {
+                    if (!session.sendError(error_msg)) {
+                        perror("Send failed");
+                        break;
+                    }
+                }
+                else {
+                    options.measure = true;
+                    if (!handleReceiveCommand(session, options)) {
+                        perror("Measure operation failed");
+                    }
+                }
+            }
             else if (strcmp(buffer, "stop") == 0) {
                 if (dac_transmitting) {
                     dac_transmitting = false;
-                    size_t zeroLength = 1024; 
-                    uint32_t *zeroBuf = g_dacZmod->allocChannelsBuffer(zeroLength);
                     
-                    if (zeroBuf) {
-                        memset(zeroBuf, 0, zeroLength * sizeof(uint32_t));
-                        g_dacZmod->setData(zeroBuf, zeroLength);
+                    if (g_dacZeroWave) {
+                        g_dacZmod->setData(g_dacZeroWave.data(), DAC_ZERO_LENGTH);
                         g_dacZmod->start(); 
-                        usleep(10000); 
+                        usleep(DAC_ZERO_SETTLE_US); 
                         g_dacZmod->stop(); 
-                        usleep(10000); 
-                        g_dacZmod->freeChannelsBuffer(zeroBuf, zeroLength);
                     }
                     
                     const char* reply = "Transmission stopped";
-                    if (send(client_fd, reply, strlen(reply), 0) < 0) {
+                    if (!session.sendText(reply)) {
                         perror("Send failed");
                         break;
                     }
@@ -1034,7 +2342,7 @@ int main() {
                     
                 } else {
                     const char* reply = "Nothing to stop";
-                    if (send(client_fd, reply, strlen(reply), 0) < 0) {
+                    if (!session.sendText(reply)) {
                         perror("Send failed");
                         break;
                     }
@@ -1043,14 +2351,14 @@ int main() {
             else if (strcmp(buffer, "exit") == 0) {
                 // Clean exit
                 const char* reply = "Goodbye";
-                send(client_fd, reply, strlen(reply), 0);
+                session.sendText(reply);
                 printf("Client requested exit\n");
                 break;
             }
             else {
                 // Unknown command
                 const char* reply = "Unknown command";
-                if (send(client_fd, reply, strlen(reply), 0) < 0) {
+                if (!session.sendError(reply)) {
                     perror("Send failed");
                     break;
                 }
@@ -1062,8 +2370,9 @@ int main() {
     }
     
     // Clean up hardware
-    delete g_dacZmod;
-    delete g_adcZmod;
+    releaseHardware();
+    delete g_threadPool;
+    g_threadPool = NULL;
     
     close(server_fd);
     printf("Server shutdown complete\n");